@@ -0,0 +1,29 @@
+/*
+  Sends continuous RSSI/SNR sweeps of the FM band as compact binary frames.
+  Decode them on your computer with extras/tools/qn800x_sweep_decode.py. Example:
+
+  python3 qn800x_sweep_decode.py --port /dev/ttyUSB0 --baud 115200
+
+  By PU2CLR, 2024.
+*/
+
+#include <QN800X.h>
+
+QN800X rx;
+
+void setup() {
+  qn800x_system1 system1;
+
+  Serial.begin(115200);
+  while (!Serial);
+
+  // Receiver mode with the channel set by the user (CCA_CH_DIS = 1)
+  system1.raw = 0;
+  system1.arg.CCA_CH_DIS = 1;
+  system1.arg.RXREQ = 1;
+  rx.setRegister(QN_SYSTEM1, system1.raw);
+}
+
+void loop() {
+  rx.sweep(280, 640, 2, Serial);   // 90 to 108 MHz, 100kHz step
+}
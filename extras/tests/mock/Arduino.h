@@ -0,0 +1,67 @@
+/*
+ * Minimal Arduino core for the host tests (see extras/tests/run_tests.sh).
+ * Time is simulated: it only advances through delay, delayMicroseconds and the Wire mock.
+ *
+ * By PU2CLR, 2024.
+ */
+#ifndef _MOCK_ARDUINO_H
+#define _MOCK_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROGMEM
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define LOW 0
+#define HIGH 1
+#define DEC 10
+#define HEX 16
+#define SDA 18
+#define SCL 19
+
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define memcpy_P memcpy
+#define strcpy_P strcpy
+
+extern uint32_t mockMicros;  // Simulated time (us)
+extern uint8_t mockSdaLevel; // Level read on SDA by the bus recovery (HIGH = released)
+extern uint32_t mockPinTime; // Simulated time (us) of each pinMode, digitalWrite and digitalRead call
+
+inline uint32_t micros() { return mockMicros; }
+inline uint32_t millis() { return mockMicros / 1000; }
+inline void delayMicroseconds(uint32_t us) { mockMicros += us; }
+inline void delay(uint32_t ms) { mockMicros += ms * 1000; }
+inline void pinMode(uint8_t, uint8_t) { mockMicros += mockPinTime; }
+inline void digitalWrite(uint8_t, uint8_t) { mockMicros += mockPinTime; }
+inline int digitalRead(uint8_t pin) { mockMicros += mockPinTime; return (pin == SDA) ? mockSdaLevel : HIGH; }
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  size_t write(const uint8_t *buffer, size_t size) {
+    for (size_t i = 0; i < size; i++)
+      this->write(buffer[i]);
+    return size;
+  }
+  size_t print(const char *text) { return this->write((const uint8_t *)text, strlen(text)); }
+  size_t print(char c) { return this->write((uint8_t)c); }
+  size_t print(long value, int base = DEC) {
+    char text[24];
+    snprintf(text, sizeof(text), (base == HEX) ? "%lX" : "%ld", value);
+    return this->print(text);
+  }
+  size_t print(int value, int base = DEC) { return this->print((long)value, base); }
+  size_t print(unsigned int value, int base = DEC) { return this->print((long)value, base); }
+  size_t print(unsigned long value, int base = DEC) { return this->print((long)value, base); }
+  size_t println() { return this->print('\n'); }
+  template <typename T> size_t println(T value) { return this->print(value) + this->println(); }
+  template <typename T> size_t println(T value, int base) { return this->print(value, base) + this->println(); }
+};
+
+#endif
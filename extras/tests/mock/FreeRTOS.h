@@ -0,0 +1,70 @@
+/*
+ * FreeRTOS shim for the host tests: semaphores and task notifications on top of std::thread.
+ * Each std::thread is a task. Only the functions used by QN800XCommandQueue are provided.
+ *
+ * By PU2CLR, 2024.
+ */
+#ifndef _MOCK_FREERTOS_H
+#define _MOCK_FREERTOS_H
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+
+#define portMAX_DELAY    0xFFFFFFFFu
+#define pdTRUE           1
+#define pdFALSE          0
+#define pdMS_TO_TICKS(x) ((TickType_t)(x)) // 1 tick = 1 ms
+
+struct MockEvent {
+  std::mutex mutex;
+  std::condition_variable changed;
+  uint32_t count;
+  uint32_t max;
+
+  MockEvent(uint32_t count = 0, uint32_t max = 0xFFFFFFFFu) : count(count), max(max) {}
+
+  // Waits for count > 0. Returns the count taken (all of it if clear is true, otherwise 1) or 0 on timeout.
+  uint32_t take(TickType_t timeout, bool clear) {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    auto ready = [this] { return this->count > 0; };
+    if (timeout == portMAX_DELAY)
+      this->changed.wait(lock, ready);
+    else if (!this->changed.wait_for(lock, std::chrono::milliseconds(timeout), ready))
+      return 0;
+    uint32_t taken = clear ? this->count : 1;
+    this->count -= taken;
+    return taken;
+  }
+
+  void give() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->count < this->max)
+      this->count++;
+    this->changed.notify_all();
+  }
+};
+
+typedef MockEvent *SemaphoreHandle_t;
+typedef MockEvent *TaskHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return new MockEvent(1, 1); }
+inline SemaphoreHandle_t xSemaphoreCreateCounting(uint32_t max, uint32_t initial) { return new MockEvent(initial, max); }
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout) { return semaphore->take(timeout, false) ? pdTRUE : pdFALSE; }
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) { semaphore->give(); return pdTRUE; }
+
+// The notification of a task is never released: xTaskNotifyGive may still be running when the task ends
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+  static thread_local MockEvent *task = new MockEvent;
+  return task;
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t timeout) { return xTaskGetCurrentTaskHandle()->take(timeout, clear == pdTRUE); }
+inline void xTaskNotifyGive(TaskHandle_t task) { task->give(); }
+
+#endif
@@ -0,0 +1,68 @@
+/*
+ * Wire mock for the host tests: a QN800X register file behind a fault injector.
+ * Define MOCK_NO_WIRE_TIMEOUT to build it as a core without Wire timeout support.
+ *
+ * By PU2CLR, 2024.
+ */
+#ifndef _MOCK_WIRE_H
+#define _MOCK_WIRE_H
+
+#include <Arduino.h>
+
+#ifndef MOCK_NO_WIRE_TIMEOUT
+#define WIRE_HAS_TIMEOUT
+#endif
+
+#define MOCK_OK           0  // Transaction succeeds
+#define MOCK_NACK_ADDRESS 2  // endTransmission returns 2
+#define MOCK_NACK_DATA    3  // endTransmission returns 3
+#define MOCK_TIMEOUT      5  // endTransmission returns 5 after the Wire timeout
+#define MOCK_SHORT_READ   6  // requestFrom returns one byte less than requested
+
+#define MOCK_BYTE_TIME    90 // Time (us) of one byte at 100kHz
+#define MOCK_MAX_ATTEMPTS 16
+
+class TwoWire {
+public:
+  void begin() { this->begins++; }
+  void setClock(uint32_t) {}
+  void setWireTimeout(uint32_t timeout, bool) { this->timeout = timeout; }
+
+  void beginTransmission(uint8_t address);
+  size_t write(uint8_t value);
+  uint8_t endTransmission(bool stop = true);
+  uint8_t requestFrom(uint8_t address, uint8_t count);
+  int available() { return this->rxCount - this->rxIndex; }
+  int read() { return (this->rxIndex < this->rxCount) ? this->rx[this->rxIndex++] : -1; }
+
+  void reset();
+  void inject(uint8_t fault, uint8_t times);
+
+  uint8_t registers[256];   // Device register file
+  uint8_t address = 0x2B;   // Device address
+  uint32_t timeout = 0;     // Timeout set by setWireTimeout (us)
+  uint16_t attempts = 0;    // Transactions started (beginTransmission)
+  uint16_t begins = 0;      // Wire.begin calls (the bus recovery restarts Wire)
+  uint32_t attemptTime[MOCK_MAX_ATTEMPTS]; // Start time of each transaction
+  uint16_t writes = 0;      // Successful register writes (transactions with data)
+  uint16_t writtenBytes = 0;// Register bytes written by them
+  uint8_t writeFirst[MOCK_MAX_ATTEMPTS];  // First register of each write
+  uint8_t writeCount[MOCK_MAX_ATTEMPTS];  // Number of registers of each write
+  void (*onRead)(uint8_t first, uint8_t count) = NULL; // Called before each read (updates the volatile registers)
+
+private:
+  uint8_t fault = MOCK_OK;  // Fault injected in the next transactions
+  uint8_t faultCount = 0;   // Number of transactions that still fail
+  uint8_t current = MOCK_OK;
+  uint8_t target = 0;
+  uint8_t pointer = 0;
+  uint8_t tx[40];
+  uint8_t txCount = 0;
+  uint8_t rx[40];
+  uint8_t rxCount = 0;
+  uint8_t rxIndex = 0;
+};
+
+extern TwoWire Wire;
+
+#endif
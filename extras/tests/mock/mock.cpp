@@ -0,0 +1,86 @@
+/*
+ * Wire mock for the host tests (see Wire.h).
+ *
+ * By PU2CLR, 2024.
+ */
+#include <Wire.h>
+
+uint32_t mockMicros = 0;
+uint8_t mockSdaLevel = HIGH;
+uint32_t mockPinTime = 0;
+TwoWire Wire;
+
+void TwoWire::reset() {
+  memset(this->registers, 0, sizeof(this->registers));
+  this->attempts = this->begins = 0;
+  this->writes = this->writtenBytes = 0;
+  this->fault = this->current = MOCK_OK;
+  this->faultCount = 0;
+  this->onRead = NULL;
+}
+
+void TwoWire::inject(uint8_t fault, uint8_t times) {
+  this->fault = fault;
+  this->faultCount = times;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+  if (this->attempts < MOCK_MAX_ATTEMPTS)
+    this->attemptTime[this->attempts] = mockMicros;
+  this->attempts++;
+  this->target = address;
+  this->txCount = 0;
+  this->current = MOCK_OK;
+  if (this->faultCount) {
+    this->faultCount--;
+    this->current = this->fault;
+  }
+}
+
+size_t TwoWire::write(uint8_t value) {
+  if (this->txCount >= sizeof(this->tx))
+    return 0;
+  this->tx[this->txCount++] = value;
+  return 1;
+}
+
+uint8_t TwoWire::endTransmission(bool) {
+  mockMicros += (this->txCount + 1) * MOCK_BYTE_TIME;
+  if (this->current == MOCK_TIMEOUT) {
+    mockMicros += this->timeout;
+    return MOCK_TIMEOUT;
+  }
+  if (this->current == MOCK_NACK_ADDRESS || this->target != this->address)
+    return MOCK_NACK_ADDRESS;
+  if (this->current == MOCK_NACK_DATA)
+    return MOCK_NACK_DATA;
+  if (this->txCount) {
+    this->pointer = this->tx[0];
+    for (uint8_t i = 1; i < this->txCount; i++)
+      this->registers[(uint8_t)(this->pointer + i - 1)] = this->tx[i];
+    if (this->txCount > 1) {
+      if (this->writes < MOCK_MAX_ATTEMPTS) {
+        this->writeFirst[this->writes] = this->pointer;
+        this->writeCount[this->writes] = this->txCount - 1;
+      }
+      this->writes++;
+      this->writtenBytes += this->txCount - 1;
+    }
+  }
+  return MOCK_OK;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t count) {
+  this->rxCount = this->rxIndex = 0;
+  if (address != this->address || count > sizeof(this->rx))
+    return 0;
+  if (this->onRead != NULL)
+    this->onRead(this->pointer, count);
+  if (this->current == MOCK_SHORT_READ)
+    count--;
+  for (uint8_t i = 0; i < count; i++)
+    this->rx[i] = this->registers[(uint8_t)(this->pointer + i)];
+  this->rxCount = count;
+  mockMicros += (count + 1) * MOCK_BYTE_TIME;
+  return count;
+}
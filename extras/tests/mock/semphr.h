@@ -0,0 +1,4 @@
+/*
+ * FreeRTOS shim for the host tests (see FreeRTOS.h).
+ */
+#include <FreeRTOS.h>
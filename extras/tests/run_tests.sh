@@ -0,0 +1,68 @@
+#!/bin/sh
+#
+# Builds and runs the host tests of the QN800X library with the Arduino and Wire mocks in extras/tests/mock.
+# No board is needed: only a C++11 compiler with ThreadSanitizer support (g++ by default; set CXX to use another one).
+#
+# Usage: extras/tests/run_tests.sh
+#
+# By PU2CLR, 2024.
+
+CXX=${CXX:-g++}
+DIR=$(cd "$(dirname "$0")" && pwd)
+SRC=$DIR/../../src
+OUT=${TMPDIR:-/tmp}/qn800x_tests
+CXXFLAGS="-std=gnu++11 -Wall -Wextra -I$DIR/mock -I$SRC"
+
+mkdir -p "$OUT" || exit 1
+STATUS=0
+
+# test_trace and test_scan save a trace and a sweep frame here for the Python tools
+QN800X_TRACE_FILE=$OUT/trace.bin
+QN800X_SWEEP_FILE=$OUT/sweep.bin
+export QN800X_TRACE_FILE QN800X_SWEEP_FILE
+rm -f "$QN800X_TRACE_FILE" "$QN800X_SWEEP_FILE" "$QN800X_SWEEP_FILE.csv"
+
+# Test name, source and extra flags
+while read -r NAME SOURCE FLAGS; do
+  if $CXX $CXXFLAGS $FLAGS -o "$OUT/$NAME" "$DIR/$SOURCE" "$DIR/mock/mock.cpp" "$SRC/QN800X.cpp"; then
+    "$OUT/$NAME" || STATUS=1
+  else
+    echo "$NAME: build failed"
+    STATUS=1
+  fi
+done <<LIST
+test_i2c            test_i2c.cpp
+test_i2c_no_timeout test_i2c.cpp -DMOCK_NO_WIRE_TIMEOUT
+test_scan           test_scan.cpp
+test_batch          test_batch.cpp
+test_rds_tx         test_rds_tx.cpp
+test_rds_rx         test_rds_rx.cpp
+test_registers      test_registers.cpp
+test_trace          test_trace.cpp -DQN800X_FEATURE_TRACE=1
+test_cmd_queue      test_cmd_queue.cpp -DQN800X_FEATURE_CMD_QUEUE=1 -pthread
+test_cmd_queue_tsan test_cmd_queue.cpp -DQN800X_FEATURE_CMD_QUEUE=1 -pthread -fsanitize=thread -g
+LIST
+
+# The replay tool must read the trace recorded by test_trace: 10 transactions, 6 of them probes, 1 read error
+if command -v python3 >/dev/null 2>&1; then
+  if [ -f "$QN800X_TRACE_FILE" ] &&
+     python3 "$DIR/../tools/qn800x_trace_replay.py" --json "$QN800X_TRACE_FILE" |
+     python3 -c 'import json, sys; r = json.load(sys.stdin); sys.exit(not (r["transactions"], r["probes"], r["errors"]) == (10, 6, 1))'; then
+    echo "qn800x_trace_replay: OK"
+  else
+    echo "qn800x_trace_replay: FAILED"
+    STATUS=1
+  fi
+  # The reference decoder must give the samples of the frame sent by test_scan
+  if [ -f "$QN800X_SWEEP_FILE" ] &&
+     python3 "$DIR/../tools/qn800x_sweep_decode.py" --csv "$QN800X_SWEEP_FILE" | cmp -s - "$QN800X_SWEEP_FILE.csv"; then
+    echo "qn800x_sweep_decode: OK"
+  else
+    echo "qn800x_sweep_decode: FAILED"
+    STATUS=1
+  fi
+else
+  echo "qn800x_trace_replay, qn800x_sweep_decode: skipped (python3 not found)"
+fi
+
+exit $STATUS
@@ -0,0 +1,130 @@
+/*
+ * Host test of QN800XBatch: merged updates, dropped no-ops, burst writes, gap bridging and SYSTEM1 written last.
+ * The Wire mock (mock/Wire.h) counts the write transactions and the register bytes written.
+ *
+ * Build and run with extras/tests/run_tests.sh.
+ *
+ * By PU2CLR, 2024.
+ */
+#include <QN800X.h>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                    \
+  do {                                                                      \
+    if (!(condition)) {                                                     \
+      printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition);  \
+      failures++;                                                           \
+    }                                                                       \
+  } while (0)
+
+// Starts each test with all cached registers known (the register file holds its reset values)
+static void prepare(QN800X &dv) {
+  qn800x_snapshot snapshot;
+
+  Wire.reset();
+  for (uint8_t i = 0; i < QN800X_REG_COUNT; i++)
+    Wire.registers[QN800X_REG_MAP[i].address] = QN800X_REG_MAP[i].resetValue;
+  dv.invalidateRegisterCache();
+  dv.saveSnapshot(&snapshot);
+  Wire.attempts = Wire.writes = Wire.writtenBytes = 0;
+}
+
+static void testMerge(QN800X &dv) {
+  QN800XBatch batch(dv);
+
+  prepare(dv);
+  batch.setRegister(QN_TX_FDEV, 0x10);
+  batch.setRegister(QN_TX_FDEV, 0x20);
+  batch.setField(QN_TX_FDEV, 0x0F, 0x05);
+  CHECK(batch.commit() == QN800X_I2C_OK);
+  CHECK(batch.getTransactionCount() == 1);
+  CHECK(Wire.writes == 1 && Wire.writtenBytes == 1);
+  CHECK(Wire.registers[QN_TX_FDEV] == 0x25);
+}
+
+static void testNoOps(QN800X &dv) {
+  QN800XBatch batch(dv);
+
+  prepare(dv);
+  batch.setRegister(QN_TX_FDEV, Wire.registers[QN_TX_FDEV]);
+  batch.setRegister(QN_CCA, 0x00);
+  batch.setRegister(QN_CCA, Wire.registers[QN_CCA]);  // Back to the cached value
+  CHECK(batch.commit() == QN800X_I2C_OK);
+  CHECK(batch.getTransactionCount() == 0);
+  CHECK(Wire.attempts == 0);
+
+  // Nothing pending after a commit
+  CHECK(batch.commit() == QN800X_I2C_OK);
+  CHECK(Wire.attempts == 0);
+}
+
+static void testBurst(QN800X &dv) {
+  QN800XBatch batch(dv);
+
+  prepare(dv);
+  batch.setRegister(QN_GAIN_TXPLT, 0x11);  // Set out of order
+  batch.setRegister(QN_TXAGC_GAIN, 0x22);
+  batch.setRegister(QN_TX_FDEV, 0x33);
+  CHECK(batch.commit() == QN800X_I2C_OK);
+  CHECK(Wire.writes == 1 && Wire.writtenBytes == 3);
+  CHECK(Wire.writeFirst[0] == QN_TXAGC_GAIN && Wire.writeCount[0] == 3);
+
+  // One unchanged non settling register (TX_FDEV) is rewritten to join two bursts
+  prepare(dv);
+  batch.setRegister(QN_TXAGC_GAIN, 0x44);
+  batch.setRegister(QN_GAIN_TXPLT, 0x55);
+  CHECK(batch.commit() == QN800X_I2C_OK);
+  CHECK(Wire.writes == 1 && Wire.writtenBytes == 3);
+  CHECK(Wire.registers[QN_TX_FDEV] == 0x6C);
+
+  // Registers too far apart: two bursts
+  prepare(dv);
+  batch.setRegister(QN_I2S, 0x01);
+  batch.setRegister(QN_CCA, 0x02);
+  CHECK(batch.commit() == QN800X_I2C_OK);
+  CHECK(batch.getTransactionCount() == 2);
+  CHECK(Wire.writes == 2 && Wire.writtenBytes == 2);
+}
+
+static void testSettlingBridge(QN800X &dv) {
+  QN800XBatch batch(dv);
+
+  // PAC_TARGET (between CH_STEP and TXAGC_GAIN) needs settling time: it must not be rewritten
+  prepare(dv);
+  batch.setRegister(QN_CH_STEP, 0x61);
+  batch.setRegister(QN_TXAGC_GAIN, 0x02);
+  uint32_t start = micros();
+  CHECK(batch.commit() == QN800X_I2C_OK);
+  CHECK(Wire.writes == 2 && Wire.writtenBytes == 2);
+  CHECK(Wire.writeFirst[0] == QN_CH_STEP && Wire.writeFirst[1] == QN_TXAGC_GAIN);
+  CHECK(micros() - start < QN800X_DELAY_COMMAND);
+}
+
+static void testSystem1Last(QN800X &dv) {
+  QN800XBatch batch(dv);
+
+  prepare(dv);
+  batch.setRegister(QN_SYSTEM1, 0x41);
+  batch.setRegister(QN_CH, 0x10);
+  batch.setRegister(QN_SYSTEM2, 0x08);
+  batch.setRegister(QN_CCA, 0x30);
+  CHECK(batch.commit() == QN800X_I2C_OK);
+  CHECK(batch.getTransactionCount() == 4);
+  CHECK(Wire.writes == 4);
+  CHECK(Wire.writeFirst[Wire.writes - 1] == QN_SYSTEM1 && Wire.writeCount[Wire.writes - 1] == 1);
+  CHECK(Wire.registers[QN_SYSTEM1] == 0x41);
+}
+
+int main() {
+  QN800X dv;
+
+  testMerge(dv);
+  testNoOps(dv);
+  testBurst(dv);
+  testSettlingBridge(dv);
+  testSystem1Last(dv);
+
+  printf("test_batch: %s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * Host stress test of QN800XCommandQueue: several std::thread tasks submit commands and wait on their
+ * futures while an owner thread runs them (FreeRTOS shim in mock/FreeRTOS.h).
+ * run_tests.sh also builds it with ThreadSanitizer, which reports any unsynchronized access to a future.
+ *
+ * By PU2CLR, 2024.
+ */
+#include <QN800X.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static std::atomic<int> failures(0);
+
+#define CHECK(condition)                                                    \
+  do {                                                                      \
+    if (!(condition)) {                                                     \
+      printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition);  \
+      failures++;                                                           \
+    }                                                                       \
+  } while (0)
+
+#define TASKS      6
+#define ITERATIONS 2000
+
+// Submits until the queue accepts the command
+static void submit(QN800XCommandQueue &commands, uint8_t type, uint8_t reg, uint8_t mask, uint16_t value, uint8_t priority, QN800XFuture *future) {
+  while (!commands.submit(type, reg, mask, value, priority, future)) {
+    CHECK(future->isDone() && future->error == QN800X_ERR_QUEUE_FULL);
+    std::this_thread::yield();
+  }
+}
+
+// Each task owns one bit of TXAGC_GAIN: concurrent read-modify-write on the same register
+static void testUpdates(QN800XCommandQueue &commands) {
+  std::vector<std::thread> tasks;
+
+  for (int t = 0; t < TASKS; t++) {
+    tasks.emplace_back([&commands, t] {
+      uint8_t bit = 1 << t;
+      for (int i = 0; i < ITERATIONS; i++) {
+        QN800XFuture update, read;
+        submit(commands, QN800X_CMD_UPDATE, QN_TXAGC_GAIN, bit, (i & 1) ? bit : 0, t % 3, &update);
+        CHECK(update.wait() && update.error == QN800X_I2C_OK);
+        submit(commands, QN800X_CMD_READ, QN_TXAGC_GAIN, 0, 0, 0, &read);
+        CHECK(read.wait() && read.error == QN800X_I2C_OK);
+        CHECK(((read.value & bit) != 0) == ((i & 1) != 0));
+      }
+    });
+  }
+  for (auto &task : tasks)
+    task.join();
+}
+
+// Writes and tunes without futures (merged while pending), then one write with a future per task
+static void testMergedWrites(QN800XCommandQueue &commands) {
+  std::vector<std::thread> tasks;
+
+  for (int t = 0; t < 4; t++) {
+    tasks.emplace_back([&commands, t] {
+      for (int i = 0; i < ITERATIONS; i++) {
+        commands.submit(QN800X_CMD_WRITE, QN_TX_FDEV + t, 0, i & 0xFF, 0);
+        commands.submit(QN800X_CMD_TUNE, 0, 0, i % 1000, 1);
+      }
+      QN800XFuture last;
+      submit(commands, QN800X_CMD_WRITE, QN_TX_FDEV + t, 0, 0xA0 + t, 0, &last);
+      CHECK(last.wait() && last.error == QN800X_I2C_OK);
+    });
+  }
+  for (auto &task : tasks)
+    task.join();
+  for (int t = 0; t < 4; t++)
+    CHECK(Wire.registers[QN_TX_FDEV + t] == 0xA0 + t);
+}
+
+int main() {
+  QN800X dv;
+  QN800XCommandQueue commands(dv);
+  std::atomic<bool> stop(false);
+
+  Wire.reset();
+  CHECK(commands.begin());
+
+  // Queue full: the future is completed at once
+  QN800XFuture futures[QN800X_CMD_QUEUE_SIZE + 1];
+  for (int i = 0; i < QN800X_CMD_QUEUE_SIZE; i++)
+    CHECK(commands.submit(QN800X_CMD_READ, QN_CIDR1 + i, 0, 0, 0, &futures[i]));
+  CHECK(!commands.submit(QN800X_CMD_READ, QN_STATUS1, 0, 0, 0, &futures[QN800X_CMD_QUEUE_SIZE]));
+  CHECK(futures[QN800X_CMD_QUEUE_SIZE].isDone() && futures[QN800X_CMD_QUEUE_SIZE].error == QN800X_ERR_QUEUE_FULL);
+  CHECK(!futures[0].isDone());
+  CHECK(commands.process(0) == QN800X_CMD_QUEUE_SIZE);
+  for (int i = 0; i < QN800X_CMD_QUEUE_SIZE; i++)
+    CHECK(futures[i].wait(0) && futures[i].error == QN800X_I2C_OK);
+
+  std::thread owner([&] {
+    while (!stop)
+      commands.process(pdMS_TO_TICKS(10));
+  });
+  testUpdates(commands);
+  testMergedWrites(commands);
+  stop = true;
+  owner.join();
+
+  printf("test_cmd_queue: %s (%u commands merged)\n", failures ? "FAILED" : "OK", commands.getMergedCount());
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,195 @@
+/*
+ * Host test of the QN800X I2C error handling: retries, backoff, error codes and the
+ * worst-case latency bound (see QN800X::transfer and QN800X::getI2CWorstCaseLatency).
+ * The Wire mock (mock/Wire.h) injects NACK, timeout and short-read faults.
+ *
+ * Build and run with extras/tests/run_tests.sh.
+ *
+ * By PU2CLR, 2024.
+ */
+#include <QN800X.h>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                    \
+  do {                                                                      \
+    if (!(condition)) {                                                     \
+      printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition);  \
+      failures++;                                                           \
+    }                                                                       \
+  } while (0)
+
+// Starts each test with a healthy device and the default retry policy
+static void prepare(QN800X &dv) {
+  Wire.reset();
+  mockSdaLevel = HIGH;
+  dv.setI2CRecoveryPins(SDA, SCL);
+  dv.setI2CRetryPolicy();
+}
+
+static void testNackRecovered(QN800X &dv) {
+  prepare(dv);
+  Wire.inject(MOCK_NACK_ADDRESS, 1);
+  CHECK(dv.writeRegister(QN_CCA, 0x12) == QN800X_I2C_OK);
+  CHECK(Wire.attempts == 2);
+  CHECK(Wire.registers[QN_CCA] == 0x12);
+  CHECK(Wire.begins == 0); // NACK does not need the bus recovery
+  // Backoff before the retry
+  CHECK(Wire.attemptTime[1] - Wire.attemptTime[0] >= QN800X_I2C_BACKOFF);
+}
+
+static void testNackPersistent(QN800X &dv) {
+  prepare(dv);
+  Wire.inject(MOCK_NACK_DATA, 10);
+  CHECK(dv.writeRegister(QN_CCA, 0x34) == QN800X_I2C_ERR_NACK_DATA);
+  CHECK(dv.getLastI2CError() == QN800X_I2C_ERR_NACK_DATA);
+  CHECK(Wire.attempts == QN800X_I2C_RETRIES + 1);
+  // The backoff doubles on every new attempt
+  uint32_t first = Wire.attemptTime[1] - Wire.attemptTime[0];
+  uint32_t second = Wire.attemptTime[2] - Wire.attemptTime[1];
+  CHECK(second - first == QN800X_I2C_BACKOFF);
+
+  prepare(dv);
+  dv.setI2CRetryPolicy(0);
+  Wire.inject(MOCK_NACK_ADDRESS, 10);
+  CHECK(dv.writeRegister(QN_CCA, 0x56) == QN800X_I2C_ERR_NACK_ADDRESS);
+  CHECK(Wire.attempts == 1);
+
+  prepare(dv);
+  dv.setI2CRetryPolicy(5);
+  Wire.inject(MOCK_NACK_ADDRESS, 10);
+  CHECK(dv.writeRegister(QN_CCA, 0x56) == QN800X_I2C_ERR_NACK_ADDRESS);
+  CHECK(Wire.attempts == 6);
+}
+
+static void testShortRead(QN800X &dv) {
+  uint8_t value = 0;
+
+  prepare(dv);
+  Wire.registers[QN_STATUS1] = 0x5A;
+  Wire.inject(MOCK_SHORT_READ, 1);
+  CHECK(dv.readRegister(QN_STATUS1, &value) == QN800X_I2C_OK);
+  CHECK(value == 0x5A);
+  CHECK(Wire.attempts == 2);
+
+  prepare(dv);
+  value = 0x77;
+  Wire.inject(MOCK_SHORT_READ, 10);
+  CHECK(dv.readRegister(QN_STATUS1, &value) == QN800X_I2C_ERR_SHORT_READ);
+  CHECK(value == 0x77); // Not changed on error
+  CHECK(Wire.attempts == QN800X_I2C_RETRIES + 1);
+  CHECK(Wire.available() == 0); // Partial data discarded
+}
+
+static void testTimeout(QN800X &dv) {
+  prepare(dv);
+  Wire.inject(MOCK_TIMEOUT, 1);
+  CHECK(dv.writeRegister(QN_CCA, 0x21) == QN800X_I2C_OK);
+  CHECK(Wire.attempts == 2);
+  CHECK(Wire.begins == 1); // Bus recovery before the retry
+#if !defined(MOCK_NO_WIRE_TIMEOUT)
+  CHECK(Wire.timeout == QN800X_I2C_TIMEOUT); // Restored by the recovery
+#endif
+
+  prepare(dv);
+  Wire.inject(MOCK_TIMEOUT, 10);
+  CHECK(dv.writeRegister(QN_CCA, 0x43) == QN800X_I2C_ERR_TIMEOUT);
+  CHECK(Wire.attempts == QN800X_I2C_RETRIES + 1);
+
+  // SDA held low: the recovery fails
+  prepare(dv);
+  mockSdaLevel = LOW;
+  Wire.inject(MOCK_TIMEOUT, 10);
+  CHECK(dv.writeRegister(QN_CCA, 0x65) == QN800X_I2C_ERR_BUS_STUCK);
+  CHECK(Wire.attempts == 1); // No retry on a stuck bus
+
+  // No recovery pins: the retries still run
+  prepare(dv);
+  dv.setI2CRecoveryPins(-1, -1);
+  Wire.inject(MOCK_TIMEOUT, 1);
+  CHECK(dv.writeRegister(QN_CCA, 0x66) == QN800X_I2C_OK);
+  CHECK(Wire.attempts == 2);
+}
+
+static void testWorstCaseLatency(QN800X &dv) {
+#if defined(MOCK_NO_WIRE_TIMEOUT)
+  // Without a Wire timeout there is no bound
+  prepare(dv);
+  CHECK(dv.getI2CWorstCaseLatency() == 0);
+#else
+  const uint8_t faults[] = {MOCK_NACK_ADDRESS, MOCK_NACK_DATA, MOCK_TIMEOUT, MOCK_SHORT_READ};
+  const uint8_t retries[] = {0, 1, 2, 4, 8};
+  uint8_t value;
+
+  prepare(dv);
+  // 3 attempts of 2 x 25ms + 2.5ms, 2 recoveries and the backoffs 100us and 200us
+  CHECK(QN800X_I2C_RECOVERY_TIME == 10 * 30 + 10 + 200);
+  CHECK(dv.getI2CWorstCaseLatency() == 3 * (2 * 25000UL + 2500) + 2 * QN800X_I2C_RECOVERY_TIME + 100 + 200);
+
+  for (uint8_t r = 0; r < sizeof(retries); r++) {
+    for (uint8_t f = 0; f < sizeof(faults); f++) {
+      prepare(dv);
+      dv.setI2CRetryPolicy(retries[r], 500, 2000);
+      uint32_t bound = dv.getI2CWorstCaseLatency();
+      Wire.inject(faults[f], 255);
+      uint32_t start = micros();
+      if (faults[f] == MOCK_SHORT_READ)
+        CHECK(dv.readRegister(QN_STATUS1, &value) == QN800X_I2C_ERR_SHORT_READ);
+      else
+        CHECK(dv.writeRegister(QN_SYSTEM2, 0x40) == faults[f]); // RECAL: the write needs settling time
+      CHECK(Wire.attempts == retries[r] + 1);
+      CHECK(micros() - start <= bound);
+    }
+  }
+
+  // Recovery with all 9 SCL pulses and the slowest pin calls of the estimate (the Wire restart costs nothing here)
+  prepare(dv);
+  mockSdaLevel = LOW;
+  mockPinTime = QN800X_I2C_PIN_TIME;
+  uint32_t start = micros();
+  CHECK(!dv.recoverI2CBus());
+  CHECK(micros() - start == QN800X_I2C_RECOVERY_TIME - QN800X_I2C_RESTART_TIME);
+  mockPinTime = 0;
+  mockSdaLevel = HIGH;
+#endif
+}
+
+static void testDiscovery(QN800X &dv) {
+  const uint8_t addresses[] = {QN800X_I2C_DADD_ADDRESS, QN800X_I2C_ADDRESS};
+  qn800x_i2c_device found[2];
+
+  prepare(dv);
+  Wire.registers[QN_CIDR1] = 0b00000001;  // CID1 = 000 (FM), CID2 = 01
+  Wire.registers[QN_CIDR2] = 0b00110001;  // CID3 = 0011 (QN8006), CID4 = 0001
+  CHECK(dv.discoverDevices(found, 2, addresses, 2) == 1);
+  CHECK(found[0].address == QN800X_I2C_ADDRESS);
+  CHECK(found[0].error == QN800X_I2C_OK);
+  CHECK(found[0].cidr1.arg.CID1 == 0 && found[0].cidr1.arg.CID2 == 1);
+  CHECK(found[0].cidr2.arg.CID3 == 0b0011 && found[0].cidr2.arg.CID4 == 1);
+  CHECK(found[0].part == QN800X_PART_QN8006);
+  CHECK(dv.getDevicePart() == QN800X_PART_QN8006);
+
+  prepare(dv);
+  Wire.registers[QN_CIDR2] = 0b01010000;  // CID3 = 0101 (QN8007L)
+  CHECK(dv.discoverDevices(found, 2, addresses, 2) == 1);
+  CHECK(found[0].part == QN800X_PART_QN8007L);
+
+  prepare(dv);
+  Wire.registers[QN_CIDR2] = 0b10000000;  // Reserved
+  CHECK(dv.discoverDevices(found, 2, addresses, 2) == 1);
+  CHECK(found[0].part == QN800X_PART_UNKNOWN);
+}
+
+int main() {
+  QN800X dv;
+
+  testNackRecovered(dv);
+  testNackPersistent(dv);
+  testShortRead(dv);
+  testTimeout(dv);
+  testWorstCaseLatency(dv);
+  testDiscovery(dv);
+
+  printf("test_i2c: %s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,295 @@
+/*
+ * Host test of the RDS receiver helpers: QN800XAfList, QN800XPresetStore, QN800X::switchToBestAF and
+ * QN800X::rdsWaitPI (Wire mock in mock/Wire.h).
+ *
+ * Build and run with extras/tests/run_tests.sh.
+ *
+ * By PU2CLR, 2024.
+ */
+#include <QN800X.h>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                    \
+  do {                                                                      \
+    if (!(condition)) {                                                     \
+      printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition);  \
+      failures++;                                                           \
+    }                                                                       \
+  } while (0)
+
+// 10-bit channel index of a frequency in 100kHz units (see QN800X::setFrequency)
+static uint16_t channelOf(uint16_t frequency) {
+  return (frequency - 760) * 2;
+}
+
+// Group with the given PI, group type/version (block 2) and AF codes (block 3)
+static qn800x_rds_group group(uint16_t pi, uint8_t type, bool versionB, uint8_t af1, uint8_t af2) {
+  qn800x_rds_group g;
+  g.data[0] = (uint8_t)(pi >> 8);
+  g.data[1] = (uint8_t)pi;
+  g.data[2] = (uint8_t)((type << 4) | (versionB << 3));
+  g.data[3] = 0;
+  g.data[4] = af1;
+  g.data[5] = af2;
+  g.data[6] = (uint8_t)(pi >> 8);
+  g.data[7] = (uint8_t)pi;
+  return g;
+}
+
+static void testAfList() {
+  QN800XAfList afs;
+
+  // Method A: count code (224 + 3), then 87.6MHz (code 1), 107.9MHz (code 204) and 97.5MHz (code 100)
+  CHECK(afs.decode(group(0xC203, 0, false, 227, 1)));
+  CHECK(afs.decode(group(0xC203, 0, false, 204, 100)));
+  CHECK(afs.getPI() == 0xC203);
+  CHECK(afs.getCount() == 3);
+  CHECK(afs.getChannel(0) == channelOf(876));
+  CHECK(afs.getChannel(1) == channelOf(1079));
+  CHECK(afs.getChannel(2) == channelOf(975));
+
+  // Repeated codes, filler (205), not used (0) and codes above 204 add nothing
+  CHECK(!afs.decode(group(0xC203, 0, false, 1, 205)));
+  CHECK(!afs.decode(group(0xC203, 0, false, 0, 223)));
+  CHECK(!afs.decode(group(0xC203, 0, false, 251, 255)));
+  CHECK(afs.getCount() == 3);
+
+  // 250: the next code is a LF/MF frequency, also across groups
+  CHECK(!afs.decode(group(0xC203, 0, false, 250, 10)));
+  CHECK(!afs.decode(group(0xC203, 0, false, 205, 250)));
+  CHECK(afs.decode(group(0xC203, 0, false, 20, 30)));
+  CHECK(afs.getCount() == 4);
+  CHECK(afs.getChannel(3) == channelOf(875 + 30));
+
+  // Only 0A groups carry the list
+  CHECK(!afs.decode(group(0xC203, 0, true, 40, 41)));
+  CHECK(!afs.decode(group(0xC203, 2, false, 40, 41)));
+  CHECK(afs.getCount() == 4);
+
+  // Another station clears the list
+  CHECK(afs.decode(group(0x1234, 0, false, 225, 50)));
+  CHECK(afs.getPI() == 0x1234 && afs.getCount() == 1);
+  CHECK(afs.getChannel(0) == channelOf(925));
+
+  // At most QN800X_AF_MAX frequencies
+  afs.clear();
+  for (uint8_t code = 1; code < 2 * QN800X_AF_MAX; code += 2)
+    afs.decode(group(0x1234, 0, false, code, code + 1));
+  CHECK(afs.getCount() == QN800X_AF_MAX);
+  CHECK(afs.getChannel(QN800X_AF_MAX - 1) == channelOf(875 + QN800X_AF_MAX));
+}
+
+static qn800x_preset preset(uint16_t channel, uint16_t pi, uint8_t quality) {
+  qn800x_preset p = {channel, pi, {'S', 'T', 'A', 'T', 'I', 'O', 'N', ' '}, quality};
+  return p;
+}
+
+static void testPresets() {
+  QN800XPresetStore presets;
+  uint8_t blob[QN800X_PRESET_BLOB_SIZE(QN800X_PRESET_MAX)];
+  uint16_t size;
+
+  // Sorted insert
+  CHECK(presets.add(preset(400, 0xC203, 30)));
+  CHECK(presets.add(preset(100, 0x1234, 40)));
+  CHECK(presets.add(preset(250, 0xC203, 50)));
+  CHECK(presets.getCount() == 3);
+  CHECK(presets.get(0).channel == 100 && presets.get(1).channel == 250 && presets.get(2).channel == 400);
+
+  // The same channel replaces the preset
+  CHECK(presets.add(preset(400, 0xC203, 60)));
+  CHECK(presets.getCount() == 3);
+  CHECK(presets.get(2).quality == 60);
+
+  // Binary searches
+  CHECK(presets.findByChannel(100) == 0);
+  CHECK(presets.findByChannel(400) == 2);
+  CHECK(presets.findByChannel(101) == -1);
+  CHECK(presets.findByPI(0x1234) == 0);
+  CHECK(presets.findByPI(0xC203) == 2);  // Best quality of the two channels
+  CHECK(presets.findByPI(0x0001) == -1);
+  CHECK(presets.findByPI(0xFFFF) == -1);
+
+  // Overflow: a new channel is rejected, an existing one is still replaced
+  for (uint16_t channel = 500; presets.getCount() < QN800X_PRESET_MAX; channel += 2)
+    CHECK(presets.add(preset(channel, channel, 10)));
+  CHECK(!presets.add(preset(90, 0x0090, 10)));
+  CHECK(presets.getCount() == QN800X_PRESET_MAX);
+  CHECK(presets.findByChannel(90) == -1);
+  CHECK(presets.add(preset(100, 0x1234, 70)));
+  CHECK(presets.getCount() == QN800X_PRESET_MAX && presets.get(0).quality == 70);
+  for (uint8_t i = 1; i < presets.getCount(); i++)
+    CHECK(presets.get(i - 1).channel < presets.get(i).channel);
+
+  CHECK(presets.remove(250));
+  CHECK(!presets.remove(250));
+  CHECK(presets.getCount() == QN800X_PRESET_MAX - 1);
+  CHECK(presets.findByPI(0xC203) == presets.findByChannel(400));
+
+  // Blob round trip
+  CHECK(presets.save(blob, QN800X_PRESET_BLOB_SIZE(QN800X_PRESET_MAX - 1) - 1) == 0);
+  size = presets.save(blob, sizeof(blob));
+  CHECK(size == QN800X_PRESET_BLOB_SIZE(QN800X_PRESET_MAX - 1));
+  QN800XPresetStore loaded;
+  CHECK(loaded.load(blob, size));
+  CHECK(loaded.getCount() == presets.getCount());
+  for (uint8_t i = 0; i < presets.getCount(); i++) {
+    const qn800x_preset &a = loaded.get(i), &b = presets.get(i);
+    CHECK(a.channel == b.channel && a.pi == b.pi && memcmp(a.ps, b.ps, sizeof(a.ps)) == 0 && a.quality == b.quality);
+  }
+  CHECK(loaded.findByPI(0xC203) == loaded.findByChannel(400));
+
+  // A corrupted or truncated blob is rejected and the current presets are kept
+  QN800XPresetStore other;
+  CHECK(other.add(preset(10, 0x0010, 1)));
+  for (uint16_t i = 0; i < size; i++) {
+    blob[i] ^= 0x01;
+    CHECK(!other.load(blob, size));
+    blob[i] ^= 0x01;
+  }
+  CHECK(!other.load(blob, size - 1));
+  CHECK(other.getCount() == 1 && other.get(0).channel == 10);
+  CHECK(other.load(blob, size));
+  CHECK(other.getCount() == QN800X_PRESET_MAX - 1);
+}
+
+// Signal level (RSSISIG) of each channel of the simulated band
+static uint8_t rssiOfChannel(uint16_t channel) {
+  if (channel == channelOf(1069))
+    return 20;
+  if (channel == channelOf(900))
+    return 25;
+  if (channel == channelOf(950))
+    return 30;
+  return 5;
+}
+
+static void updateSignal(uint8_t first, uint8_t) {
+  if (first == QN_RSSISIG) {
+    uint16_t channel = Wire.registers[QN_CH] | ((uint16_t)(Wire.registers[QN_CH_STEP] & 0b00000011) << 8);
+    Wire.registers[QN_RSSISIG] = rssiOfChannel(channel);
+  }
+}
+
+static void testSwitchToBestAF(QN800X &dv) {
+  QN800XAfList afs;
+  bool switched = true;
+
+  Wire.reset();
+  Wire.registers[QN_STATUS1] = 0b00000100;  // RXAGCSET
+  Wire.onRead = updateSignal;
+  dv.invalidateRegisterCache();
+
+  // 90.0MHz is only 5dB stronger: stays on 106.9MHz and that is not an error
+  CHECK(dv.setChannel(channelOf(1069)) == QN800X_I2C_OK);
+  afs.decode(group(0xC203, 0, false, 900 - 875, 1069 - 875));
+  CHECK(dv.switchToBestAF(afs, 6, 1000, QN800X_AF_PROBE, &switched) == QN800X_I2C_OK);
+  CHECK(!switched);
+  CHECK(dv.getChannel() == channelOf(1069));
+  CHECK(Wire.registers[QN_CH] == (uint8_t)channelOf(1069));
+  CHECK(dv.switchToBestAF(afs, 6, 1000) == QN800X_I2C_OK);
+
+  // 95.0MHz is 10dB stronger
+  afs.decode(group(0xC203, 0, false, 950 - 875, 205));
+  CHECK(dv.switchToBestAF(afs, 6, 1000, QN800X_AF_PROBE, &switched) == QN800X_I2C_OK);
+  CHECK(switched);
+  CHECK(dv.getChannel() == channelOf(950));
+  CHECK(Wire.registers[QN_CH] == (uint8_t)channelOf(950));
+
+  // Bus error
+  Wire.inject(MOCK_NACK_ADDRESS, 255);
+  switched = true;
+  CHECK(dv.switchToBestAF(afs, 6, 1000, QN800X_AF_PROBE, &switched) == QN800X_I2C_ERR_NACK_ADDRESS);
+  CHECK(!switched);
+  Wire.inject(MOCK_OK, 0);
+}
+
+#define STATUS3_RDS0ERR 0b00001000
+#define STATUS3_RDSSYNC 0b00010000
+#define STATUS3_UPDATE  0b10000000
+
+static uint16_t rdsPolls = 0;   // STATUS3 reads
+static uint16_t rdsBursts = 0;  // RDSD0 to STATUS3 reads
+
+// A new group arrives before the third STATUS3 poll
+static void newGroup(uint8_t first, uint8_t count) {
+  if (first == QN_STATUS3 && count == 1 && ++rdsPolls == 3)
+    Wire.registers[QN_STATUS3] ^= STATUS3_UPDATE;
+  if (first == QN_RDSD0)
+    rdsBursts++;
+}
+
+// Another group (PI 1234h) arrives during the first burst: block 1 is half written when it is read
+static void newGroupDuringBurst(uint8_t first, uint8_t count) {
+  newGroup(first, count);
+  if (first == QN_RDSD0 && rdsBursts == 1) {
+    Wire.registers[QN_STATUS3] ^= STATUS3_UPDATE;
+    Wire.registers[QN_RDSD0] = 0x12;
+  } else if (first == QN_STATUS3 && rdsBursts == 1) {
+    Wire.registers[QN_RDSD0 + 1] = 0x34;
+  }
+}
+
+static void prepareRds(uint8_t status3, void (*source)(uint8_t, uint8_t)) {
+  Wire.reset();
+  Wire.registers[QN_RDSD0] = 0xC2;
+  Wire.registers[QN_RDSD0 + 1] = 0x03;
+  Wire.registers[QN_STATUS3] = status3;
+  Wire.onRead = source;
+  rdsPolls = rdsBursts = 0;
+}
+
+static void testWaitPI(QN800X &dv) {
+  uint16_t pi;
+  uint32_t start;
+
+  // Block 1 without error
+  prepareRds(STATUS3_RDSSYNC, newGroup);
+  pi = 0;
+  CHECK(dv.rdsWaitPI(&pi, 100) == QN800X_I2C_OK);
+  CHECK(pi == 0xC203);
+  CHECK(rdsPolls == 3 && rdsBursts == 1);
+
+  // The group read in the burst is not the one announced: rejected, the next group is accepted
+  prepareRds(STATUS3_RDSSYNC, newGroupDuringBurst);
+  pi = 0;
+  CHECK(dv.rdsWaitPI(&pi, 100) == QN800X_I2C_OK);
+  CHECK(pi == 0x1234);
+  CHECK(rdsPolls == 4 && rdsBursts == 2);
+
+  // Block 1 with error: no valid PI until the timeout
+  prepareRds(STATUS3_RDSSYNC | STATUS3_RDS0ERR, newGroup);
+  pi = 0;
+  start = millis();
+  CHECK(dv.rdsWaitPI(&pi, 20) == QN800X_ERR_NOT_READY);
+  CHECK(pi == 0);
+  CHECK(rdsBursts == 1);
+  CHECK(millis() - start >= 20 && millis() - start <= 21);
+
+  // Not synchronized: the group is not read
+  prepareRds(0, newGroup);
+  start = millis();
+  CHECK(dv.rdsWaitPI(&pi, 20) == QN800X_ERR_NOT_READY);
+  CHECK(pi == 0);
+  CHECK(rdsBursts == 0 && rdsPolls > 3);
+  CHECK(millis() - start >= 20 && millis() - start <= 21);
+
+  // Bus error
+  prepareRds(STATUS3_RDSSYNC, newGroup);
+  Wire.inject(MOCK_NACK_ADDRESS, 255);
+  CHECK(dv.rdsWaitPI(&pi, 20) == QN800X_I2C_ERR_NACK_ADDRESS);
+  Wire.inject(MOCK_OK, 0);
+}
+
+int main() {
+  QN800X dv;
+
+  testAfList();
+  testPresets();
+  testSwitchToBestAF(dv);
+  testWaitPI(dv);
+
+  printf("test_rds_rx: %s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
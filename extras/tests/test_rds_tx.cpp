@@ -0,0 +1,170 @@
+/*
+ * Host test of the RDS group encoder (QN800XRdsEncoder and QN800X_RDS_PS_GROUPS): decodes the 0A, 2A and 4A
+ * payloads, checks the RadioText A/B flag and the cycle of groups when nothing is pending.
+ *
+ * Build and run with extras/tests/run_tests.sh.
+ *
+ * By PU2CLR, 2024.
+ */
+#include <QN800X.h>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                    \
+  do {                                                                      \
+    if (!(condition)) {                                                     \
+      printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition);  \
+      failures++;                                                           \
+    }                                                                       \
+  } while (0)
+
+#define PI  0xC203
+#define PTY 10
+
+static constexpr qn800x_rds_group stationPS[4] PROGMEM = QN800X_RDS_PS_GROUPS(PI, PTY, true, false, true, 0b1001, "PU2CLR  ");
+
+static uint16_t block(const qn800x_rds_group &group, uint8_t index) {
+  return (uint16_t)((group.data[index * 2] << 8) | group.data[index * 2 + 1]);
+}
+
+static uint8_t groupType(const qn800x_rds_group &group) { return block(group, 1) >> 12; }
+static uint8_t version(const qn800x_rds_group &group) { return (block(group, 1) >> 11) & 1; }
+
+// Common fields of every group: PI, TP and PTY
+static void checkHeader(const qn800x_rds_group &group, bool tp) {
+  CHECK(block(group, 0) == PI);
+  CHECK(((block(group, 1) >> 10) & 1) == (tp ? 1 : 0));
+  CHECK(((block(group, 1) >> 5) & 0x1F) == PTY);
+}
+
+static void test0A() {
+  const char *name = "PU2CLR  ";
+  for (uint8_t segment = 0; segment < 4; segment++) {
+    const qn800x_rds_group &group = stationPS[segment];
+    uint16_t b2 = block(group, 1);
+    checkHeader(group, true);
+    CHECK(groupType(group) == 0 && version(group) == 0);
+    CHECK((b2 & 0b11) == segment);
+    CHECK(((b2 >> 4) & 1) == 0);                                 // TA
+    CHECK(((b2 >> 3) & 1) == 1);                                 // MS
+    CHECK(((b2 >> 2) & 1) == ((0b1001 >> (3 - segment)) & 1));   // DI, d3 first
+    CHECK(block(group, 2) == 0xE0CD);                            // No AF
+    CHECK(group.data[6] == name[segment * 2] && group.data[7] == name[segment * 2 + 1]);
+  }
+}
+
+static void test2A() {
+  QN800XRdsEncoder rds(PI, PTY);
+  qn800x_rds_group group;
+  char text[65] = {0};
+
+  rds.setRT("Hello RDS");  // 9 characters + CR: 3 segments
+  CHECK(rds.hasPendingGroups());
+  for (uint8_t segment = 0; segment < 3; segment++) {
+    CHECK(rds.nextGroup(group));
+    checkHeader(group, false);
+    CHECK(groupType(group) == 2 && version(group) == 0);
+    CHECK((block(group, 1) & 0x0F) == segment);
+    CHECK(((block(group, 1) >> 4) & 1) == 0);  // A/B flag
+    memcpy(&text[segment * 4], &group.data[4], 4);
+  }
+  CHECK(!rds.hasPendingGroups());
+  CHECK(memcmp(text, "Hello RDS\r  ", 12) == 0);
+
+  // Only the changed segment is pending
+  rds.setRT("Hello RDX");
+  CHECK(rds.nextGroup(group));
+  CHECK((block(group, 1) & 0x0F) == 2);
+  CHECK(!rds.hasPendingGroups());
+
+  // clear toggles the A/B flag and sends all segments again
+  rds.setRT("Hello RDX", true);
+  for (uint8_t segment = 0; segment < 3; segment++) {
+    CHECK(rds.nextGroup(group));
+    CHECK((block(group, 1) & 0x0F) == segment);
+    CHECK(((block(group, 1) >> 4) & 1) == 1);
+  }
+  rds.setRT("New text", true);
+  CHECK(rds.nextGroup(group));
+  CHECK(((block(group, 1) >> 4) & 1) == 0);
+
+  // 64 characters: 16 segments, no CR
+  QN800XRdsEncoder full(PI, PTY);
+  full.setRT("0123456789ABCDEF0123456789ABCDEF0123456789ABCDEF0123456789ABCDEF");
+  for (uint8_t segment = 0; segment < 16; segment++) {
+    CHECK(full.nextGroup(group));
+    CHECK((block(group, 1) & 0x0F) == segment);
+  }
+  CHECK(!full.hasPendingGroups());
+}
+
+static void test4A() {
+  QN800XRdsEncoder rds(PI, PTY);
+  qn800x_rds_group group;
+
+  rds.setRT("RT");
+  rds.setCT(60000, 21, 45, -6);  // MJD 60000, 21:45 UTC, -3h
+  CHECK(rds.nextGroup(group));    // Clock Time first
+  checkHeader(group, false);
+  CHECK(groupType(group) == 4 && version(group) == 0);
+  uint32_t mjd = ((uint32_t)(block(group, 1) & 0b11) << 15) | (block(group, 2) >> 1);
+  uint8_t hour = ((block(group, 2) & 1) << 4) | (block(group, 3) >> 12);
+  CHECK(mjd == 60000);
+  CHECK(hour == 21);
+  CHECK(((block(group, 3) >> 6) & 0x3F) == 45);
+  CHECK(((block(group, 3) >> 5) & 1) == 1);    // Negative offset
+  CHECK((block(group, 3) & 0x1F) == 6);
+  CHECK(rds.nextGroup(group) && groupType(group) == 2);
+
+  // The same time is not sent again
+  rds.setCT(60000, 21, 45, -6);
+  CHECK(!rds.hasPendingGroups());
+}
+
+static void testCycle() {
+  QN800XRdsEncoder rds(PI, PTY, true);
+  qn800x_rds_group group;
+
+  CHECK(!rds.nextGroup(group));  // Nothing to send
+
+  rds.setPS(stationPS);
+  rds.setRT("ABCDEFG");           // 2 segments
+  CHECK(rds.nextGroup(group) && groupType(group) == 2);
+  CHECK(rds.nextGroup(group) && groupType(group) == 2);
+
+  // Nothing pending: PS groups 0 to 3, then RT segments 0 and 1, again and again
+  for (uint8_t round = 0; round < 3; round++) {
+    for (uint8_t segment = 0; segment < 4; segment++) {
+      CHECK(rds.nextGroup(group));
+      CHECK(memcmp(&group, &stationPS[segment], sizeof(group)) == 0);
+    }
+    for (uint8_t segment = 0; segment < 2; segment++) {
+      CHECK(rds.nextGroup(group));
+      CHECK(groupType(group) == 2 && (block(group, 1) & 0x0F) == segment);
+    }
+  }
+
+  // A pending update interrupts the cycle
+  rds.setCT(60000, 1, 2);
+  CHECK(rds.nextGroup(group) && groupType(group) == 4);
+  CHECK(rds.nextGroup(group) && groupType(group) == 0);
+
+  // Without PS groups, only the RadioText is cycled
+  QN800XRdsEncoder rt(PI, PTY);
+  rt.setRT("AB");
+  CHECK(rt.nextGroup(group));
+  for (uint8_t i = 0; i < 3; i++) {
+    CHECK(rt.nextGroup(group));
+    CHECK(groupType(group) == 2 && (block(group, 1) & 0x0F) == 0);
+  }
+}
+
+int main() {
+  test0A();
+  test2A();
+  test4A();
+  testCycle();
+
+  printf("test_rds_tx: %s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
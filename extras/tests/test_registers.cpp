@@ -0,0 +1,124 @@
+/*
+ * Host test of the register map and register cache: self-clearing command bits are never written back from
+ * the cache, and dumpRegisters prints the names of QN800X_REG_MAP.
+ *
+ * Build and run with extras/tests/run_tests.sh.
+ *
+ * By PU2CLR, 2024.
+ */
+#include <QN800X.h>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                    \
+  do {                                                                      \
+    if (!(condition)) {                                                     \
+      printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition);  \
+      failures++;                                                           \
+    }                                                                       \
+  } while (0)
+
+// Keeps the text printed by dumpRegisters
+class TextOut : public Print {
+public:
+  char text[2048];
+  size_t size = 0;
+  size_t write(uint8_t c) {
+    if (this->size < sizeof(this->text) - 1)
+      this->text[this->size++] = (char)c;
+    this->text[this->size] = 0;
+    return 1;
+  }
+};
+
+static void testCommandBits(QN800X &dv) {
+  uint8_t value;
+  qn800x_reg_info info;
+
+  CHECK(dv.getRegisterInfo(QN_SYSTEM1, &info) && info.commandMask == 0x20);  // CHSC
+  CHECK(dv.getRegisterInfo(QN_SYSTEM2, &info) && info.commandMask == 0xC0);  // SWRST, RECAL
+  CHECK(dv.getRegisterInfo(QN_CCA, &info) && info.commandMask == 0 && strcmp(info.name, "CCA") == 0);
+  CHECK(QN800X_COMMAND_MASK == ((1UL << QN_SYSTEM1) | (1UL << QN_SYSTEM2)));
+
+  // RX channel scan (CHSC = 1), then standby and wake up from the cached SYSTEM1
+  Wire.reset();
+  dv.invalidateRegisterCache();
+  CHECK(dv.writeRegister(QN_SYSTEM1, 0b10100001) == QN800X_I2C_OK);
+  Wire.registers[QN_SYSTEM1] &= ~0x20;  // The device clears CHSC when the scan ends
+  CHECK(dv.getCachedRegister(QN_SYSTEM1, &value) == QN800X_I2C_OK && value == 0b10000001);
+  Wire.writes = 0;
+  CHECK(dv.setStandby() == QN800X_I2C_OK);
+  CHECK(Wire.writes == 1 && Wire.registers[QN_SYSTEM1] == 0b00010001);
+  CHECK(dv.wakeUp(false) == QN800X_I2C_OK);
+  CHECK(Wire.registers[QN_SYSTEM1] == 0b10000001);
+
+  // A read while the scan is running does not keep CHSC either
+  Wire.registers[QN_SYSTEM1] = 0b10100001;
+  dv.invalidateRegisterCache();
+  CHECK(dv.readRegister(QN_SYSTEM1, &value) == QN800X_I2C_OK && value == 0b10100001);
+  CHECK(dv.getCachedRegister(QN_SYSTEM1, &value) == QN800X_I2C_OK && value == 0b10000001);
+
+  // RECAL is sent, but not kept
+  CHECK(dv.writeRegister(QN_SYSTEM2, 0b01001001) == QN800X_I2C_OK);
+  CHECK(dv.getCachedRegister(QN_SYSTEM2, &value) == QN800X_I2C_OK && value == 0b00001001);
+}
+
+static void testRestore(QN800X &dv) {
+  qn800x_snapshot snapshot;
+
+  // Snapshot taken during a scan and a recalibration
+  Wire.reset();
+  for (uint8_t i = 0; i < QN800X_REG_COUNT; i++)
+    Wire.registers[QN800X_REG_MAP[i].address] = QN800X_REG_MAP[i].resetValue;
+  Wire.registers[QN_SYSTEM1] = 0b10100001;
+  Wire.registers[QN_SYSTEM2] = 0b11001001;
+  dv.invalidateRegisterCache();
+  CHECK(dv.saveSnapshot(&snapshot) == QN800X_I2C_OK);
+  CHECK(snapshot.raw[QN_SYSTEM1] == 0b10100001 && snapshot.raw[QN_SYSTEM2] == 0b11001001);
+
+  Wire.registers[QN_SYSTEM1] = 0x01;
+  Wire.registers[QN_SYSTEM2] = 0x09;
+  dv.invalidateRegisterCache();
+  CHECK(dv.loadSnapshot(&snapshot) == QN800X_I2C_OK);
+  CHECK(Wire.registers[QN_SYSTEM1] == 0b10000001);
+  CHECK(Wire.registers[QN_SYSTEM2] == 0b00001001);
+
+  // The device lost its configuration: restoreRegisters writes the cache back without SWRST, RECAL or CHSC
+  for (uint8_t i = 0; i < QN800X_REG_COUNT; i++)
+    Wire.registers[QN800X_REG_MAP[i].address] = 0xFF;
+  CHECK(dv.restoreRegisters() == QN800X_I2C_OK);
+  CHECK(Wire.registers[QN_SYSTEM1] == 0b10000001);
+  CHECK(Wire.registers[QN_SYSTEM2] == 0b00001001);
+  CHECK(Wire.registers[QN_CCA] == 0x49);
+}
+
+static void testDump(QN800X &dv) {
+  TextOut out;
+
+  Wire.reset();
+  for (uint8_t i = 0; i < QN800X_REG_COUNT; i++)
+    Wire.registers[QN800X_REG_MAP[i].address] = QN800X_REG_MAP[i].resetValue;
+  Wire.registers[QN_CCA] = 0x12;
+  CHECK(dv.dumpRegisters(out) == QN800X_I2C_OK);
+  CHECK(strstr(out.text, "00 SYSTEM1  01  01 W--\n") != NULL);
+  CHECK(strstr(out.text, "0C PAC_TRGT FF  FF W-S\n") != NULL);
+  CHECK(strstr(out.text, "19 CCA      12* 49 W--\n") != NULL);
+  CHECK(strstr(out.text, "5A PAG_CAL  0F  0F WVS\n") != NULL);
+
+  // One line per register of the map
+  size_t lines = 0;
+  for (size_t i = 0; i < out.size; i++)
+    lines += (out.text[i] == '\n');
+  CHECK(lines == QN800X_REG_COUNT);
+}
+
+int main() {
+  QN800X dv;
+
+  testCommandBits(dv);
+  testRestore(dv);
+  testDump(dv);
+
+  printf("test_registers: %s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,183 @@
+/*
+ * Host test of QN800X::sweep and QN800X::scanStations (Wire mock in mock/Wire.h): argument checks and the
+ * sweep frame encoding. The frame is decoded here and also saved to $QN800X_SWEEP_FILE, with the expected
+ * samples in $QN800X_SWEEP_FILE.csv, so run_tests.sh can check extras/tools/qn800x_sweep_decode.py too.
+ *
+ * Build and run with extras/tests/run_tests.sh.
+ *
+ * By PU2CLR, 2024.
+ */
+#include <QN800X.h>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                    \
+  do {                                                                      \
+    if (!(condition)) {                                                     \
+      printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition);  \
+      failures++;                                                           \
+    }                                                                       \
+  } while (0)
+
+// Counts the bytes of a sweep frame
+class CountOut : public Print {
+public:
+  size_t count = 0;
+  size_t write(uint8_t) { this->count++; return 1; }
+};
+
+static void testSweep(QN800X &dv) {
+  CountOut out;
+
+  Wire.reset();
+  Wire.registers[QN_STATUS1] = 0b00000100;  // RXAGCSET
+  CHECK(dv.sweep(300, 310, 0, out) == QN800X_ERR_INVALID_ARGUMENT);
+  CHECK(dv.sweep(310, 300, 2, out) == QN800X_ERR_INVALID_ARGUMENT);
+  CHECK(dv.sweep(1000, 1024, 2, out) == QN800X_ERR_INVALID_ARGUMENT);
+  CHECK(out.count == 0);
+  CHECK(Wire.attempts == 0);
+
+  // Header (8 bytes), 6 channels (2 + 5 bytes) and CRC (2 bytes)
+  CHECK(dv.sweep(300, 310, 2, out) == QN800X_I2C_OK);
+  CHECK(out.count == 8 + 7 + 2);
+  CHECK(dv.getChannel() == 310);
+
+  out.count = 0;
+  CHECK(dv.sweep(1023, 1023, 255, out) == QN800X_I2C_OK);
+  CHECK(out.count == 8 + 2 + 2);
+}
+
+// Keeps a sweep frame
+class FrameOut : public Print {
+public:
+  uint8_t data[128];
+  size_t size = 0;
+  size_t write(uint8_t c) {
+    if (this->size < sizeof(this->data))
+      this->data[this->size++] = c;
+    return 1;
+  }
+};
+
+#define FRAME_FIRST 300
+#define FRAME_STEP  2
+#define FRAME_COUNT 12
+
+// RSSI and SNR of each channel: small deltas (-7 and 7 included), (-8, -8), 8 and -8 in one field, no change
+static const uint8_t frameSamples[FRAME_COUNT][2] = {
+  {30, 20}, {37, 13}, {30, 20}, {22, 12}, {22, 12}, {30, 12}, {30, 4}, {23, 11}, {15, 11}, {200, 0}, {193, 7}, {0, 255}
+};
+
+static void updateSignal(uint8_t first, uint8_t) {
+  if (first == QN_RSSISIG) {
+    uint16_t channel = Wire.registers[QN_CH] | ((uint16_t)(Wire.registers[QN_CH_STEP] & 0b00000011) << 8);
+    uint16_t index = (channel - FRAME_FIRST) / FRAME_STEP;
+    Wire.registers[QN_RSSISIG] = frameSamples[index][0];
+    Wire.registers[QN_SNR] = frameSamples[index][1];
+  }
+}
+
+static uint16_t crc16(const uint8_t *data, size_t size) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < size; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (uint8_t bit = 0; bit < 8; bit++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+static int8_t nibble(uint8_t value) {
+  return (value & 0x08) ? (int8_t)value - 16 : (int8_t)value;
+}
+
+static void testSweepFrame(QN800X &dv) {
+  FrameOut out;
+  uint8_t rssi = 0, snr = 0;
+  uint8_t escapes = 0;
+  size_t n = 8;
+
+  Wire.reset();
+  Wire.registers[QN_STATUS1] = 0b00000100;  // RXAGCSET
+  Wire.onRead = updateSignal;
+  dv.invalidateRegisterCache();
+  CHECK(dv.sweep(FRAME_FIRST, FRAME_FIRST + (FRAME_COUNT - 1) * FRAME_STEP, FRAME_STEP, out) == QN800X_I2C_OK);
+
+  // Header: sync, version, first channel, step and count
+  CHECK(out.data[0] == 0x51 && out.data[1] == 0x53 && out.data[2] == 1);
+  CHECK((out.data[3] | (out.data[4] << 8)) == FRAME_FIRST);
+  CHECK(out.data[5] == FRAME_STEP);
+  CHECK((out.data[6] | (out.data[7] << 8)) == FRAME_COUNT);
+
+  for (uint8_t i = 0; i < FRAME_COUNT && n < out.size; i++) {
+    uint8_t code = (i == 0) ? 0x88 : out.data[n++];
+    int16_t deltaRssi = (int16_t)frameSamples[i][0] - rssi;
+    int16_t deltaSnr = (int16_t)frameSamples[i][1] - snr;
+    bool fits = i > 0 && deltaRssi >= -7 && deltaRssi <= 7 && deltaSnr >= -7 && deltaSnr <= 7;
+    if (code == 0x88) {
+      CHECK(!fits);  // Never a (-8, -8) delta
+      rssi = out.data[n++];
+      snr = out.data[n++];
+      escapes += (i > 0);
+    } else {
+      CHECK(fits);
+      rssi += nibble(code >> 4);
+      snr += nibble(code & 0x0F);
+    }
+    CHECK(rssi == frameSamples[i][0] && snr == frameSamples[i][1]);
+  }
+  CHECK(escapes == 6);
+  CHECK(out.data[8 + 2] == 0x79);      // (7, -7)
+  CHECK(out.data[8 + 2 + 1] == 0x97);  // (-7, 7)
+  CHECK(out.data[8 + 2 + 2] == 0x88);  // (-8, -8) is sent as escape
+
+  // CRC of all previous bytes, little endian
+  CHECK(out.size == n + 2);
+  uint16_t crc = crc16(out.data, n);
+  CHECK(out.data[n] == (uint8_t)crc && out.data[n + 1] == (uint8_t)(crc >> 8));
+
+  const char *path = getenv("QN800X_SWEEP_FILE");
+  if (path != NULL) {
+    char csvPath[512];
+    FILE *file = fopen(path, "wb");
+    CHECK(file != NULL && fwrite(out.data, 1, out.size, file) == out.size);
+    if (file != NULL)
+      fclose(file);
+    snprintf(csvPath, sizeof(csvPath), "%s.csv", path);
+    file = fopen(csvPath, "w");
+    CHECK(file != NULL);
+    for (uint8_t i = 0; file != NULL && i < FRAME_COUNT; i++)
+      fprintf(file, "0,%.2f,%d,%d\n", 76 + (FRAME_FIRST + i * FRAME_STEP) * 0.05, frameSamples[i][0], frameSamples[i][1]);
+    if (file != NULL)
+      fclose(file);
+  }
+}
+
+static void testScanStations(QN800X &dv) {
+  qn800x_station stations[4];
+  uint8_t found = 0xFF;
+
+  Wire.reset();
+  CHECK(dv.scanStations(300, 310, 0, 20, stations, 4, &found) == QN800X_ERR_INVALID_ARGUMENT);
+  CHECK(found == 0);
+  CHECK(dv.scanStations(310, 300, 2, 20, stations, 4, &found) == QN800X_ERR_INVALID_ARGUMENT);
+  CHECK(dv.scanStations(0, 1100, 2, 20, stations, 4, &found) == QN800X_ERR_INVALID_ARGUMENT);
+  CHECK(Wire.attempts == 0);
+
+  // No station above the RSSI threshold
+  Wire.registers[QN_STATUS1] = 0b00000100;  // RXAGCSET
+  CHECK(dv.scanStations(1020, 1023, 1, 20, stations, 4, &found) == QN800X_I2C_OK);
+  CHECK(found == 0);
+  CHECK(dv.getChannel() == 1023);
+}
+
+int main() {
+  QN800X dv;
+
+  testSweep(dv);
+  testSweepFrame(dv);
+  testScanStations(dv);
+
+  printf("test_scan: %s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * Host test of the register transaction trace (QN800X::setTrace) on the Wire mock (mock/Wire.h).
+ * The records are decoded here; the trace is also saved to $QN800X_TRACE_FILE, so run_tests.sh can replay it
+ * with extras/tools/qn800x_trace_replay.py.
+ *
+ * Build and run with extras/tests/run_tests.sh.
+ *
+ * By PU2CLR, 2024.
+ */
+#include <QN800X.h>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                    \
+  do {                                                                      \
+    if (!(condition)) {                                                     \
+      printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition);  \
+      failures++;                                                           \
+    }                                                                       \
+  } while (0)
+
+// Keeps the trace
+class TraceOut : public Print {
+public:
+  uint8_t data[512];
+  size_t size = 0;
+  size_t write(uint8_t c) {
+    if (this->size < sizeof(this->data))
+      this->data[this->size++] = c;
+    return 1;
+  }
+};
+
+// One decoded transaction record
+struct Record {
+  uint8_t flags;
+  uint8_t reg;
+  uint8_t count;
+  uint32_t delta;
+  uint32_t duration;
+  uint8_t error;
+  uint8_t values[8];
+};
+
+static uint32_t varint(const TraceOut &out, size_t &position) {
+  uint32_t value = 0;
+  for (uint8_t shift = 0; position < out.size; shift += 7) {
+    uint8_t byte = out.data[position++];
+    value |= (uint32_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      break;
+  }
+  return value;
+}
+
+static bool next(const TraceOut &out, size_t &position, Record &record) {
+  if (position + 3 > out.size)
+    return false;
+  record.flags = out.data[position++];
+  record.reg = out.data[position++];
+  record.count = out.data[position++];
+  record.delta = varint(out, position);
+  record.duration = varint(out, position);
+  record.error = (record.flags & 2) ? out.data[position++] : 0;
+  if ((record.flags & 1) || !record.error) {
+    for (uint8_t i = 0; i < record.count; i++)
+      record.values[i] = out.data[position++];
+  }
+  return position <= out.size;
+}
+
+int main() {
+  QN800X dv;
+  TraceOut out;
+  Record record;
+  uint8_t value;
+  size_t position = 3;
+  const uint8_t addresses[] = {0x2C, QN800X_I2C_ADDRESS};
+  qn800x_i2c_device devices[2];
+
+  Wire.reset();
+  for (uint8_t i = 0; i < QN800X_REG_COUNT; i++)
+    Wire.registers[QN800X_REG_MAP[i].address] = QN800X_REG_MAP[i].resetValue;
+  Wire.registers[QN_CIDR1] = 0x11;
+  Wire.registers[QN_CIDR2] = 0x22;
+  dv.setI2CRetryPolicy(0);
+
+  dv.setTrace(&out);
+  CHECK(out.size == 3 && out.data[0] == 'Q' && out.data[1] == 'T' && out.data[2] == 2);
+
+  CHECK(dv.detectDevice(true));
+  delay(2);  // Delta above 127us: two varint bytes
+  CHECK(dv.writeRegister(QN_CCA, 0x12) == QN800X_I2C_OK);
+  CHECK(dv.readRegister(QN_STATUS1, &value) == QN800X_I2C_OK);
+  Wire.inject(MOCK_NACK_DATA, 1);
+  CHECK(dv.readRegister(QN_STATUS1, &value) == QN800X_I2C_ERR_NACK_DATA);
+  Wire.address = 0x2C;
+  CHECK(dv.discoverDevices(devices, 2, addresses, 2) == 1);  // ID read of another device
+  Wire.address = QN800X_I2C_ADDRESS;
+  CHECK(dv.discoverDevices(devices, 2, addresses, 2) == 1);  // ID read of the current device
+  dv.setTrace(NULL);
+  CHECK(dv.writeRegister(QN_CCA, 0x13) == QN800X_I2C_OK);
+
+  // detectDevice: probe of the current address
+  CHECK(next(out, position, record));
+  CHECK(record.flags == 0b101 && record.reg == QN800X_I2C_ADDRESS && record.count == 0);
+  CHECK(record.duration == MOCK_BYTE_TIME);
+
+  // Write
+  CHECK(out.data[position + 3] & 0x80);
+  CHECK(next(out, position, record));
+  CHECK(record.flags == 0b001 && record.reg == QN_CCA && record.count == 1 && record.values[0] == 0x12);
+  CHECK(record.delta == MOCK_BYTE_TIME + 2000);
+  CHECK(record.duration == 3 * MOCK_BYTE_TIME);
+
+  // Read
+  CHECK(next(out, position, record));
+  CHECK(record.flags == 0b000 && record.reg == QN_STATUS1 && record.count == 1 && record.values[0] == 0);
+  CHECK(record.delta == 3 * MOCK_BYTE_TIME);
+
+  // Failed read: error code and no data
+  CHECK(next(out, position, record));
+  CHECK(record.flags == 0b010 && record.reg == QN_STATUS1 && record.error == QN800X_I2C_ERR_NACK_DATA);
+
+  // First discovery: the current address does not answer, 0x2C does
+  CHECK(next(out, position, record));
+  CHECK(record.flags == 0b101 && record.reg == 0x2C && record.count == 0);
+  CHECK(next(out, position, record));
+  CHECK(record.flags == 0b100 && record.reg == 0x2C && record.count == 2);
+  CHECK(record.values[0] == 0x11 && record.values[1] == 0x22);
+  CHECK(next(out, position, record));
+  CHECK(record.flags == 0b111 && record.reg == QN800X_I2C_ADDRESS && record.error == QN800X_I2C_ERR_NACK_ADDRESS);
+
+  // Second discovery: the ID read of the current device is a register read
+  CHECK(next(out, position, record));
+  CHECK(record.flags == 0b111 && record.reg == 0x2C);
+  CHECK(next(out, position, record));
+  CHECK(record.flags == 0b101 && record.reg == QN800X_I2C_ADDRESS);
+  CHECK(next(out, position, record));
+  CHECK(record.flags == 0b000 && record.reg == QN_CIDR1 && record.count == 2);
+  CHECK(record.values[0] == 0x11 && record.values[1] == 0x22);
+
+  // Nothing after setTrace(NULL)
+  CHECK(position == out.size);
+
+  const char *path = getenv("QN800X_TRACE_FILE");
+  if (path != NULL) {
+    FILE *file = fopen(path, "wb");
+    CHECK(file != NULL && fwrite(out.data, 1, out.size, file) == out.size);
+    if (file != NULL)
+      fclose(file);
+  }
+
+  printf("test_trace: %s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+"""
+Reference decoder for the binary sweep frames sent by QN800X::sweep().
+
+Reads frames from a file (or stdin) or from a serial port and prints one table per frame
+(frequency, RSSI and SNR), or CSV lines with --csv (one line per channel, prefixed by the frame number).
+
+Usage:
+    python3 qn800x_sweep_decode.py capture.bin
+    python3 qn800x_sweep_decode.py --port /dev/ttyUSB0 --baud 115200 --csv
+
+The serial option requires pyserial (pip install pyserial).
+
+By PU2CLR, 2024.
+"""
+
+import argparse
+import struct
+import sys
+
+SYNC = b"QS"
+VERSION = 1
+ESCAPE = 0x88
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/CCITT (polynomial 0x1021, init 0xFFFF), the same used by the library."""
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def nibble(value):
+    """Converts a 4-bit two's complement value to int."""
+    return value - 16 if value & 0x08 else value
+
+
+class ByteReader:
+    """Reads bytes from a binary stream and keeps the bytes of the current frame."""
+
+    def __init__(self, stream):
+        self.stream = stream
+        self.frame = bytearray()
+
+    def read(self, size=1):
+        data = self.stream.read(size)
+        if len(data) < size:
+            raise EOFError
+        self.frame += data
+        return data
+
+    def byte(self):
+        return self.read(1)[0]
+
+
+def frames(stream):
+    """Yields (first_channel, step, samples) for each valid frame; samples is a list of (rssi, snr)."""
+    reader = ByteReader(stream)
+    previous = b""
+    while True:
+        try:
+            current = reader.stream.read(1)
+            if not current:
+                return
+            # Look for the sync bytes
+            if previous + current != SYNC:
+                previous = current
+                continue
+            previous = b""
+            reader.frame = bytearray(SYNC)
+            if reader.byte() != VERSION:
+                continue
+            first, step, count = struct.unpack("<HBH", reader.read(5))
+            samples = []
+            rssi = snr = 0
+            for index in range(count):
+                code = reader.byte() if index > 0 else ESCAPE
+                if code == ESCAPE:
+                    rssi, snr = reader.read(2)
+                else:
+                    rssi = (rssi + nibble(code >> 4)) & 0xFF
+                    snr = (snr + nibble(code & 0x0F)) & 0xFF
+                samples.append((rssi, snr))
+            expected = crc16(reader.frame)
+            received = struct.unpack("<H", reader.stream.read(2))[0]
+            if expected != received:
+                print("CRC error: frame discarded", file=sys.stderr)
+                continue
+            yield first, step, samples
+        except (EOFError, struct.error):
+            return
+
+
+def frequency(channel):
+    """Channel frequency in MHz."""
+    return 76 + channel * 0.05
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decodes QN800X sweep frames.")
+    parser.add_argument("file", nargs="?", help="binary capture (default: stdin)")
+    parser.add_argument("--port", help="serial port (requires pyserial)")
+    parser.add_argument("--baud", type=int, default=115200, help="serial baud rate")
+    parser.add_argument("--csv", action="store_true", help="print CSV lines: frame,MHz,rssi,snr")
+    args = parser.parse_args()
+
+    if args.port:
+        import serial
+        stream = serial.Serial(args.port, args.baud)
+    elif args.file:
+        stream = open(args.file, "rb")
+    else:
+        stream = sys.stdin.buffer
+
+    for number, (first, step, samples) in enumerate(frames(stream)):
+        if args.csv:
+            for index, (rssi, snr) in enumerate(samples):
+                print("%d,%.2f,%d,%d" % (number, frequency(first + index * step), rssi, snr))
+        else:
+            print("Frame %d: %d channels" % (number, len(samples)))
+            print("   MHz   RSSI  SNR")
+            for index, (rssi, snr) in enumerate(samples):
+                print("%7.2f %5d %4d" % (frequency(first + index * step), rssi, snr))
+        sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,245 @@
+#!/usr/bin/env python3
+"""
+Replays a register transaction trace recorded by QN800X::setTrace() against a simulated QN800X.
+
+The simulated device uses the register map of the library (QN800X_REG_MAP in src/QN800X.h), so the
+attributes (writable mask, volatile, settling) are always the same used by the firmware.
+The replay is deterministic: the same trace always gives the same report.
+
+The report shows:
+  - bus time: recorded time per register and in total, and the time expected by a bus model
+    (I2C clock, settling delay); transactions much slower than expected usually mean retries or timeouts;
+  - redundant writes: writes that did not change the (known) register content;
+  - cacheable reads: reads of non volatile registers whose content was already known;
+  - divergences: reads of non volatile registers that returned a value different from the expected one
+    (the device changed it, or the trace is incomplete);
+  - probes: address only transactions (device detection and discovery), counted in the bus time only.
+
+Usage:
+    python3 qn800x_trace_replay.py trace.bin
+    python3 qn800x_trace_replay.py trace.bin --clock 400000 --json > report.json
+
+By PU2CLR, 2024.
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "src", "QN800X.h")
+
+FLAG_WRITE = 0x01
+FLAG_ERROR = 0x02
+FLAG_PROBE = 0x04
+
+REG_VOLATILE = 0x01
+REG_SETTLING = 0x02
+
+DELAY_COMMAND = 2500    # QN800X_DELAY_COMMAND (us)
+
+
+def load_register_map(header):
+    """Returns {address: (name, reset, write_mask, flags, command_mask)} parsed from QN800X_REG_MAP."""
+    text = open(header).read()
+    addresses = {name: int(value, 16) for name, value in re.findall(r"#define\s+(QN_\w+)\s+(0x[0-9A-Fa-f]+)", text)}
+    flags = {"QN800X_REG_VOLATILE": REG_VOLATILE, "QN800X_REG_SETTLING": REG_SETTLING}
+    table = text[text.index("QN800X_REG_MAP[]"):]
+    table = table[:table.index("};")]
+    registers = {}
+    entry = r'\{(QN_\w+),\s*"(\w+)",\s*(0x[0-9A-Fa-f]+),\s*(0x[0-9A-Fa-f]+),\s*(0x[0-9A-Fa-f]+),\s*([^}]*)\}'
+    for register, name, reset, mask, command, attributes in re.findall(entry, table):
+        value = 0
+        for attribute in attributes.split("|"):
+            attribute = attribute.strip()
+            value |= flags.get(attribute, 0) if not attribute.isdigit() else int(attribute)
+        registers[addresses[register]] = (name, int(reset, 16), int(mask, 16), value, int(command, 16))
+    return registers
+
+
+def varint(data, position):
+    """Decodes an unsigned varint (7 bits per byte). Returns (value, new position)."""
+    value = shift = 0
+    while True:
+        byte = data[position]
+        position += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, position
+
+
+def records(data):
+    """Yields one dict per transaction of the trace."""
+    if data[:2] != b"QT" or data[2:3] not in (b"\x01", b"\x02"):
+        raise ValueError("not a QN800X trace (version 1 or 2)")
+    position = 3
+    time = 0
+    while position < len(data):
+        try:
+            flags, register, count = data[position], data[position + 1], data[position + 2]
+            delta, position = varint(data, position + 3)
+            duration, position = varint(data, position)
+            error = 0
+            if flags & FLAG_ERROR:
+                error = data[position]
+                position += 1
+            values = b""
+            if flags & FLAG_WRITE or not error:
+                values = data[position:position + count]
+                position += count
+                if len(values) < count:
+                    return
+        except IndexError:
+            return
+        time += delta
+        yield {"time": time, "write": bool(flags & FLAG_WRITE), "probe": bool(flags & FLAG_PROBE),
+               "register": register, "count": count, "duration": duration, "error": error, "values": list(values)}
+
+
+class SimulatedDevice:
+    """Register model: keeps the known content of non volatile registers."""
+
+    def __init__(self, registers):
+        self.registers = registers
+        self.known = {}
+
+    def attributes(self, address):
+        return self.registers.get(address, ("REG_%02X" % address, 0, 0xFF, REG_VOLATILE, 0))
+
+    def write(self, address, value):
+        """Returns True if the write changed (or may have changed) the register."""
+        _, _, mask, flags, command = self.attributes(address)
+        if flags & REG_VOLATILE:
+            return True
+        previous = self.known.get(address)
+        if address == 0x01 and value & 0x80:   # SWRST: all registers return to their reset values
+            self.known = {a: r[1] for a, r in self.registers.items() if not r[3] & REG_VOLATILE}
+            return True
+        value &= ~command   # self-clearing command bits (CHSC, SWRST, RECAL) read back as 0
+        self.known[address] = value & mask if previous is None else (previous & ~mask) | (value & mask)
+        return previous is None or previous != self.known[address]
+
+    def read(self, address, value):
+        """Returns (cacheable, divergent)."""
+        _, _, _, flags, command = self.attributes(address)
+        if flags & REG_VOLATILE:
+            return False, False
+        value &= ~command
+        previous = self.known.get(address)
+        self.known[address] = value
+        return previous is not None, previous is not None and previous != value
+
+
+def settles(address, value, registers):
+    """Same rule as QN800X::needsSettling: a register with command bits (SYSTEM2) only waits for a command."""
+    _, _, _, flags, command = registers.get(address, ("", 0, 0, 0, 0))
+    if not flags & REG_SETTLING:
+        return False
+    return bool(value & command) if command else True
+
+
+def expected_duration(record, registers, clock):
+    """Bus model: 9 clocks per byte (address, register, data) plus the settling delay of the library."""
+    if record["probe"]:
+        size = 1 if record["write"] else 4 + record["count"]
+        return size * 9 * 1e6 / clock
+    size = 2 + record["count"] if record["write"] else 4 + record["count"]
+    duration = size * 9 * 1e6 / clock
+    if record["write"] and any(settles(record["register"] + i, value, registers)
+                               for i, value in enumerate(record["values"])):
+        duration += DELAY_COMMAND
+    return duration
+
+
+def replay(data, registers, clock, slow_factor):
+    device = SimulatedDevice(registers)
+    report = {"transactions": 0, "errors": 0, "bus_time_us": 0, "expected_time_us": 0, "span_us": 0,
+              "redundant_writes": 0, "redundant_write_time_us": 0, "cacheable_reads": 0,
+              "cacheable_read_time_us": 0, "divergences": 0, "slow_transactions": 0, "probes": 0, "registers": {}}
+    for record in records(data):
+        report["transactions"] += 1
+        report["bus_time_us"] += record["duration"]
+        report["span_us"] = record["time"] + record["duration"]
+        expected = expected_duration(record, registers, clock)
+        report["expected_time_us"] += int(expected)
+        if record["duration"] > expected * slow_factor:
+            report["slow_transactions"] += 1
+        if record["probe"]:   # A NACK only means there is no device at that address
+            report["probes"] += 1
+            continue
+        if record["error"]:
+            report["errors"] += 1
+            continue
+
+        changed = cacheable = 0
+        for index, value in enumerate(record["values"]):
+            address = (record["register"] + index) & 0xFF
+            name = device.attributes(address)[0]
+            stats = report["registers"].setdefault(name, {"reads": 0, "writes": 0, "redundant_writes": 0,
+                                                          "cacheable_reads": 0, "time_us": 0})
+            stats["time_us"] += record["duration"] // record["count"]
+            if record["write"]:
+                stats["writes"] += 1
+                if device.write(address, value):
+                    changed += 1
+                else:
+                    stats["redundant_writes"] += 1
+            else:
+                stats["reads"] += 1
+                known, divergent = device.read(address, value)
+                if known:
+                    stats["cacheable_reads"] += 1
+                    cacheable += 1
+                if divergent:
+                    report["divergences"] += 1
+
+        if record["write"] and changed == 0:
+            report["redundant_writes"] += 1
+            report["redundant_write_time_us"] += record["duration"]
+        if not record["write"] and cacheable == record["count"]:
+            report["cacheable_reads"] += 1
+            report["cacheable_read_time_us"] += record["duration"]
+    return report
+
+
+def print_report(report):
+    print("Transactions:      %d (%d errors, %d slower than expected)" %
+          (report["transactions"], report["errors"], report["slow_transactions"]))
+    print("Trace span:        %.3f ms" % (report["span_us"] / 1000.0))
+    print("Bus time:          %.3f ms (bus model: %.3f ms)" %
+          (report["bus_time_us"] / 1000.0, report["expected_time_us"] / 1000.0))
+    print("Redundant writes:  %d transactions, %.3f ms" %
+          (report["redundant_writes"], report["redundant_write_time_us"] / 1000.0))
+    print("Cacheable reads:   %d transactions, %.3f ms" %
+          (report["cacheable_reads"], report["cacheable_read_time_us"] / 1000.0))
+    print("Divergences:       %d" % report["divergences"])
+    print("Probes:            %d" % report["probes"])
+    print()
+    print("Register    Reads Writes Redundant Cacheable  Time(ms)")
+    for name, stats in sorted(report["registers"].items(), key=lambda item: -item[1]["time_us"]):
+        print("%-10s %6d %6d %9d %9d %9.3f" % (name, stats["reads"], stats["writes"], stats["redundant_writes"],
+                                               stats["cacheable_reads"], stats["time_us"] / 1000.0))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Replays a QN800X register transaction trace.")
+    parser.add_argument("trace", help="binary trace recorded by QN800X::setTrace")
+    parser.add_argument("--clock", type=int, default=100000, help="I2C clock used by the bus model (Hz)")
+    parser.add_argument("--slow", type=float, default=2.0, help="a transaction is slow if it takes more than SLOW times the bus model")
+    parser.add_argument("--header", default=HEADER, help="QN800X.h with the register map")
+    parser.add_argument("--json", action="store_true", help="print the report as JSON")
+    args = parser.parse_args()
+
+    registers = load_register_map(args.header)
+    report = replay(open(args.trace, "rb").read(), registers, args.clock, args.slow)
+    if args.json:
+        json.dump(report, sys.stdout, indent=2, sort_keys=True)
+        print()
+    else:
+        print_report(report)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+# Prints the flash/RAM cost of each QN800X library component (see src/QN800XConfig.h).
+# It builds extras/tools/size_report/size_report.ino with all components enabled and then
+# with each component disabled. The difference is the cost of the component.
+#
+# Requirements: arduino-cli with the board core installed and this library visible to it
+# (for example, cloned into your Arduino libraries folder).
+#
+# Usage: extras/tools/size_report.sh [FQBN]      (default: arduino:avr:uno)
+#
+# By PU2CLR, 2024.
+
+FQBN=${1:-arduino:avr:uno}
+SKETCH=$(dirname "$0")/size_report
+
+# Builds the sketch with the given flags and prints "<flash> <ram>"
+build() {
+  arduino-cli compile --fqbn "$FQBN" --build-property "compiler.cpp.extra_flags=$1" "$SKETCH" 2>&1 |
+    awk '/Sketch uses/ { flash = $3 } /Global variables use/ { ram = $4 } END { print flash, ram }'
+}
+
+set -- $(build "")
+ALL_FLASH=$1
+ALL_RAM=$2
+if [ -z "$ALL_FLASH" ]; then
+  echo "Build failed. Check arduino-cli and the FQBN ($FQBN)."
+  exit 1
+fi
+
+printf "%-12s %10s %10s\n" "Component" "Flash" "RAM"
+printf "%-12s %10s %10s\n" "all" "$ALL_FLASH" "$ALL_RAM"
+
+# Component name and the flags that remove it (and the components that depend on it)
+while read -r NAME FLAGS; do
+  set -- $(build "$FLAGS")
+  printf "%-12s %10d %10d\n" "$NAME" $((ALL_FLASH - $1)) $((ALL_RAM - $2))
+done <<LIST
+RX          -DQN800X_FEATURE_RX=0 -DQN800X_FEATURE_RDS_RX=0 -DQN800X_FEATURE_SCAN=0 -DQN800X_FEATURE_ROLE_SWITCH=0
+RDS_TX      -DQN800X_FEATURE_RDS_TX=0
+RDS_RX      -DQN800X_FEATURE_RDS_RX=0
+SCAN        -DQN800X_FEATURE_SCAN=0
+ROLE_SWITCH -DQN800X_FEATURE_ROLE_SWITCH=0
+POWER       -DQN800X_FEATURE_POWER=0
+TELEMETRY   -DQN800X_FEATURE_TELEMETRY=0
+FREQ_STRING -DQN800X_FEATURE_FREQ_STRING=0
+LIST
+
+set -- $(build "-DQN800X_FEATURE_RX=0 -DQN800X_FEATURE_RDS_TX=0 -DQN800X_FEATURE_RDS_RX=0 -DQN800X_FEATURE_SCAN=0 -DQN800X_FEATURE_POWER=0 -DQN800X_FEATURE_TELEMETRY=0 -DQN800X_FEATURE_FREQ_STRING=0 -DQN800X_FEATURE_ROLE_SWITCH=0")
+printf "%-12s %10s %10s\n" "core only" "$1" "$2"
@@ -0,0 +1,119 @@
+/*
+  Sketch used by extras/tools/size_report.sh to measure the flash/RAM cost of each QN800X component.
+  It calls every public function of each enabled component, so the linker keeps them all and the
+  report shows the full cost of the component.
+
+  By PU2CLR, 2024.
+*/
+
+#include <QN800X.h>
+
+QN800X dv;
+
+#if QN800X_FEATURE_RDS_TX
+static constexpr qn800x_rds_group stationPS[4] PROGMEM = QN800X_RDS_PS_GROUPS(0x1234, 10, false, false, true, 0, "PU2CLR  ");
+QN800XRdsEncoder rds(0x1234, 10);
+#endif
+
+#if QN800X_FEATURE_RDS_RX
+QN800XAfList afList;
+QN800XPresetStore presets;
+uint8_t presetBlob[QN800X_PRESET_BLOB_SIZE(QN800X_PRESET_MAX)];
+#endif
+
+#if QN800X_FEATURE_SCAN && QN800X_FEATURE_RDS_RX
+qn800x_station stations[8];
+#endif
+
+static const uint16_t hopFrequencies[2] = {1069, 1071};
+qn800x_hop hops[2];
+
+void setup() {
+  uint8_t value;
+  qn800x_i2c_device devices[2];
+
+  Serial.begin(9600);
+
+  dv.discoverDevices(devices, 2);
+  dv.detectDevice(true);
+  dv.readRegister(QN_SYSTEM1, &value);
+  dv.setFrequency(1069);
+  dv.buildHopTable(hopFrequencies, hops, 2);
+  dv.hopTo(hops[1]);
+
+#if QN800X_FEATURE_RX
+  uint8_t rssi, snr;
+  dv.waitForRxReady();
+  dv.getSignalQuality(&rssi, &snr);
+#endif
+
+#if QN800X_FEATURE_SCAN
+  dv.sweep(0, 400, 2, Serial);
+#endif
+
+#if QN800X_FEATURE_RDS_TX
+  qn800x_rds_group group;
+  rds.setPS(stationPS);
+  rds.setRT("QN800X");
+  if (rds.nextGroup(group) && dv.isRdsGroupFetched())
+    dv.rdsSendGroup(group);
+  dv.rdsSendGroupFromFlash(&stationPS[0]);
+#endif
+
+#if QN800X_FEATURE_RDS_RX
+  qn800x_rds_group received;
+  uint16_t pi = 0;
+  bool switched;
+  if (dv.rdsGetGroup(&received) == QN800X_I2C_OK)
+    afList.decode(received);
+  dv.switchToBestAF(afList, 6, 1000, QN800X_AF_PROBE, &switched);
+  if (dv.rdsWaitPI(&pi, QN800X_PI_TIMEOUT) == QN800X_I2C_OK) {
+    qn800x_preset preset = {dv.getChannel(), pi, "PU2CLR ", 0};
+    presets.add(preset);
+  }
+  presets.findByPI(pi);
+  presets.load(presetBlob, presets.save(presetBlob, sizeof(presetBlob)));
+#endif
+
+#if QN800X_FEATURE_SCAN && QN800X_FEATURE_RDS_RX
+  uint8_t found;
+  dv.scanStations(0, 400, 2, 20, stations, 8, &found);
+#endif
+
+#if QN800X_FEATURE_ROLE_SWITCH
+  dv.saveRoleProfile(QN800X_ROLE_RX);
+  dv.switchRole(QN800X_ROLE_TX);
+#endif
+
+#if QN800X_FEATURE_POWER
+  dv.setIdleTimeout(1);
+  dv.setStandby();
+  dv.wakeUp();
+  dv.setPowerSchedule(60000, 500);
+#endif
+
+#if QN800X_FEATURE_TRACE
+  dv.setTrace(&Serial);
+#endif
+
+#if QN800X_FEATURE_FREQ_STRING
+  Serial.print(dv.formatCurrentFrequency());
+#endif
+}
+
+void loop() {
+#if QN800X_FEATURE_POWER
+  if (dv.powerTask() == QN800X_POWER_ERROR)
+    Serial.print(dv.getPowerError());
+#endif
+#if QN800X_FEATURE_TELEMETRY
+  volatile uint32_t latency = dv.getTuneLatency() + dv.getI2CWorstCaseLatency();
+#if QN800X_FEATURE_ROLE_SWITCH
+  latency += dv.getRoleSwitchTime();
+#endif
+#if QN800X_FEATURE_POWER
+  latency += dv.getDutyCycle() + dv.getEstimatedDutyCycle() + dv.getWakeLatency();
+#endif
+  (void)latency;
+#endif
+}
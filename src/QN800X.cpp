@@ -20,108 +20,2005 @@
 /**
  * @ingroup group01 Detect Device
  * @brief   Checks communication with QN800X via I2C
- * @details Checks if the QN800X is available on the I2C bus. Remember that the QN800X responds to the address 0x21
+ * @details Checks if the QN800X is available on the I2C bus at the device address (see setDeviceAddress).
+ * @details The result is kept in RAM: next calls (and the calls after discoverDevices) do not access the bus.
+ * @param refresh if true, probes the device again
  * @return  true or false
  */
-bool QN800X::detectDevice() {
+bool QN800X::detectDevice(bool refresh) {
+
+  if (refresh || this->deviceDetected < 0) {
+    Wire.begin();
+    this->deviceDetected = (this->probeAddress(this->deviceAddress) == QN800X_I2C_OK);
+  }
+  return this->deviceDetected == 1;
+}
+
+/**
+ * @ingroup group01 Device Checking
+ * @brief Checks whether a device acknowledges an I2C address (address only transaction)
+ * @details The probe is sent to the trace (see setTrace).
+ * @param address 7-bit I2C address
+ * @return uint8_t QN800X_I2C_OK if the address was acknowledged or the Wire error code
+ */
+uint8_t QN800X::probeAddress(uint8_t address) {
+#if QN800X_FEATURE_TRACE
+  uint32_t start = micros();
+#endif
+  Wire.beginTransmission(address);
+  uint8_t error = Wire.endTransmission();
+#if QN800X_FEATURE_TRACE
+  if (this->traceOut)
+    this->traceTransaction(address, NULL, 0, false, error, start, true);
+#endif
+  return error;
+}
+
+/**
+ * @ingroup group01 Scan I2C Devices
+ * @brief  Scans the I2C bus and returns the addresses of the devices found.
+ * @details Searches for devices connected to the I2C bus. The addresses of the devices found are stored in the "device" array.
+ * @param device array of device addresses found.
+ * @return uint8_t number of devices found or 0 if no device found or error.
+ */
+uint8_t QN800X::scanI2CBus(uint8_t *device) {
+
+  int  error, address;
+  uint8_t idxDevice = 0;
+
+  Wire.begin();
+
+  for (address = 1; address < 127; address++) {
+    error = this->probeAddress(address);
+    delayMicroseconds(200);
+
+    if (error == 0) {
+      device[idxDevice] = address;
+      idxDevice++;
+    } else if (error == 4) {
+      return 0;
+    }
+  }
+  return idxDevice;
+}
+
+/**
+ * @ingroup group01 Scan I2C Devices
+ * @brief Finds the devices on the I2C bus and reads their ID registers (CIDR1 and CIDR2) in the same pass
+ * @details Probes only the addresses of the allowlist or, without allowlist, all addresses from 1 to 126.
+ * @details Each probe uses its own Wire timeout (when supported by the platform) and an optional delay.
+ * @details An error on one address does not stop the discovery; a timeout or bus error triggers the bus recovery.
+ * @details The QN8006 and QN8007 are told apart by the product ID (CID3), decoded into the part field.
+ * @details The result for the current device address is kept (see detectDevice, getDeviceProductID and getDeviceProductFamily).
+ * @details Reading the ID registers writes the register address (05h) to every device found. Use an allowlist
+ * @details if other devices on the bus may be affected by that.
+ * @param devices receives the devices found
+ * @param maxDevices size of devices. The discovery stops when it is full
+ * @param allowlist addresses to be probed or NULL to probe all addresses
+ * @param allowCount number of addresses in allowlist
+ * @param probeTimeout Wire timeout in us of each probe
+ * @param probeDelay delay in us after each probe
+ * @return uint8_t number of devices found
+ * @code
+ * const uint8_t qnAddresses[] = {QN800X_I2C_ADDRESS, QN800X_I2C_DADD_ADDRESS};
+ * qn800x_i2c_device found[2];
+ * uint8_t count = dv.discoverDevices(found, 2, qnAddresses, 2);
+ * if (count > 0 && found[0].address != dv.getDeviceAddress())
+ *   dv.setDeviceAddress(found[0].address);
+ * @endcode
+ */
+uint8_t QN800X::discoverDevices(qn800x_i2c_device *devices, uint8_t maxDevices, const uint8_t *allowlist, uint8_t allowCount, uint32_t probeTimeout, uint16_t probeDelay) {
+
+  uint8_t total = allowlist ? allowCount : 126;
+  uint8_t found = 0;
+  uint8_t error;
 
   Wire.begin();
-  // check 0x21 I2C address
-  Wire.beginTransmission(QN800X_I2C_ADDRESS);
-  return !Wire.endTransmission();
+  this->applyWireTimeout(probeTimeout);
+
+  for (uint8_t i = 0; i < total && found < maxDevices; i++) {
+    uint8_t address = allowlist ? allowlist[i] : i + 1;
+
+    error = this->probeAddress(address);
+    if (probeDelay)
+      delayMicroseconds(probeDelay);
+
+    if (error != QN800X_I2C_OK) {
+      if (address == this->deviceAddress)
+        this->deviceDetected = 0;
+      if (error == QN800X_I2C_ERR_TIMEOUT || error == QN800X_I2C_ERR_OTHER) {
+        this->recoverI2CBus();
+        this->applyWireTimeout(probeTimeout);
+      }
+      continue;
+    }
+
+    qn800x_i2c_device *device = &devices[found++];
+    device->address = address;
+    device->cidr1.raw = device->cidr2.raw = 0;
+    device->part = QN800X_PART_UNKNOWN;
+#if QN800X_FEATURE_TRACE
+    uint32_t start = micros();
+#endif
+    Wire.beginTransmission(address);
+    Wire.write(QN_CIDR1);
+    if ((error = Wire.endTransmission()) == QN800X_I2C_OK) {
+      if (Wire.requestFrom(address, (uint8_t)2) == 2) {
+        device->cidr1.raw = Wire.read();
+        device->cidr2.raw = Wire.read();
+      } else {
+        while (Wire.available())
+          Wire.read();
+        error = QN800X_I2C_ERR_SHORT_READ;
+      }
+    }
+#if QN800X_FEATURE_TRACE
+    // A register read of the current device; the ID read of other devices is a probe record
+    if (this->traceOut) {
+      uint8_t id[2] = {device->cidr1.raw, device->cidr2.raw};
+      bool other = (address != this->deviceAddress);
+      this->traceTransaction(other ? address : QN_CIDR1, id, 2, true, error, start, other);
+    }
+#endif
+    device->error = error;
+    if (error == QN800X_I2C_OK)
+      device->part = decodePart(device->cidr2);
+
+    if (address == this->deviceAddress) {
+      this->deviceDetected = 1;
+      if (error == QN800X_I2C_OK) {
+        this->shadow[QN_CIDR1] = device->cidr1.raw;
+        this->shadow[QN_CIDR2] = device->cidr2.raw;
+        this->shadowValid |= ((uint32_t)1 << QN_CIDR1) | ((uint32_t)1 << QN_CIDR2);
+      }
+    }
+  }
+
+  this->applyWireTimeout(this->i2cTimeout);
+  return found;
+}
+
+/**
+ * @ingroup group01 Device Checking
+ * @brief Sets the 7-bit I2C address used to access the device
+ * @details Use it when the device was set to another address (SEB=1 and DADD in DEV_ADD). See discoverDevices.
+ * @details The register content kept in RAM and the detection result are discarded.
+ * @param address 7-bit I2C address. Example: QN800X_I2C_DADD_ADDRESS
+ */
+void QN800X::setDeviceAddress(uint8_t address) {
+  this->deviceAddress = address;
+  this->deviceDetected = -1;
+  this->shadowValid = 0;
+}
+
+/** @defgroup group02 Basic Functions*/
+
+/**
+ * @ingroup group02 I2C
+ * @brief Runs a register transaction with bounded retries
+ * @details Each failed attempt is followed by a backoff delay that doubles on every new attempt (limited to QN800X_I2C_BACKOFF_MAX).
+ * @details Wire timeouts and bus errors also trigger the SCL pulse bus recovery before the next attempt.
+ * @details If the recovery cannot release SDA, there is no further attempt (QN800X_I2C_ERR_BUS_STUCK).
+ * @details Writes to registers with the QN800X_REG_SETTLING attribute (SYSTEM2 only with SWRST or RECAL) are followed by QN800X_DELAY_COMMAND.
+ * @param registerNumber first register
+ * @param data values to be written or buffer that receives the values read
+ * @param count number of registers
+ * @param isRead true to read; false to write
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X_I2C_ERR_* codes
+ */
+uint8_t QN800X::transfer(uint8_t registerNumber, uint8_t *data, uint8_t count, bool isRead) {
+
+  uint8_t error;
+  uint16_t backoff = this->i2cBackoff;
+#if QN800X_FEATURE_TRACE
+  uint32_t start = micros();
+#endif
+
+  for (uint8_t attempt = 0;; attempt++) {
+    Wire.beginTransmission(this->deviceAddress);
+    Wire.write(registerNumber);
+    if (!isRead) {
+      for (uint8_t i = 0; i < count; i++)
+        Wire.write(data[i]);
+    }
+    error = Wire.endTransmission();
+    if (error == QN800X_I2C_OK) {
+      if (isRead) {
+        if (Wire.requestFrom(this->deviceAddress, count) == count) {
+          for (uint8_t i = 0; i < count; i++)
+            data[i] = Wire.read();
+        } else {
+          while (Wire.available())
+            Wire.read();
+          error = QN800X_I2C_ERR_SHORT_READ;
+        }
+      }
+    }
+
+    if (error == QN800X_I2C_OK || attempt >= this->i2cMaxRetries)
+      break;
+
+    if (error == QN800X_I2C_ERR_TIMEOUT || error == QN800X_I2C_ERR_OTHER) {
+      if (!this->recoverI2CBus() && this->i2cSdaPin >= 0 && this->i2cSclPin >= 0) {
+        error = QN800X_I2C_ERR_BUS_STUCK; // No retry while SDA is held low
+        break;
+      }
+    }
+    delayMicroseconds(backoff);
+    backoff = (backoff < QN800X_I2C_BACKOFF_MAX / 2) ? backoff * 2 : QN800X_I2C_BACKOFF_MAX;
+  }
+
+  this->lastI2CError = error;
+
+  if (error == QN800X_I2C_OK && !isRead && this->needsSettling(registerNumber, data, count))
+    delayMicroseconds(QN800X_DELAY_COMMAND);
+
+#if QN800X_FEATURE_TRACE
+  if (this->traceOut)
+    this->traceTransaction(registerNumber, data, count, isRead, error, start);
+#endif
+
+  if (error == QN800X_I2C_OK) {
+    for (uint8_t i = 0; i < count; i++) {
+      uint8_t reg = registerNumber + i;
+      if (this->isCacheable(reg)) {
+        this->shadow[reg] = data[i] & ~this->getCommandBits(reg);
+        this->shadowValid |= (uint32_t)1 << reg;
+      }
+    }
+    // SWRST sets all registers to their default values
+    if (!isRead && registerNumber <= QN_SYSTEM2 && registerNumber + count > QN_SYSTEM2 && (data[QN_SYSTEM2 - registerNumber] & 0x80))
+      this->shadowValid = 0;
+  }
+
+  return error;
+}
+
+#if QN800X_FEATURE_TRACE
+/**
+ * @ingroup group02 I2C
+ * @brief Sends an unsigned number using 7 bits per byte (bit 7 set means more bytes follow)
+ */
+static void traceVarint(Print *out, uint32_t value) {
+  while (value > 0x7F) {
+    out->write((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  out->write((uint8_t)value);
+}
+
+/**
+ * @ingroup group02 I2C
+ * @brief Starts or stops the binary trace of all register transactions
+ * @details The trace starts with "QT" and the version (2). Each transaction is then sent as:
+ * | Field     | Size   | Description                                                        |
+ * | --------- | ------ | ------------------------------------------------------------------ |
+ * | Flags     | 1      | bit 0: 1 = write, 0 = read; bit 1: error; bit 2: probe             |
+ * | Register  | 1      | First register (probe: 7-bit I2C address)                          |
+ * | Count     | 1      | Number of registers                                                |
+ * | Delta     | varint | Time (us) since the beginning of the previous transaction          |
+ * | Duration  | varint | Time (us) spent by the transaction (retries and settling included) |
+ * | Error     | 1      | Only when the error flag is set: QN800X error code                 |
+ * | Data      | Count  | Values written or read (no data for a failed read)                 |
+ * @details Probes are the address only transactions of detectDevice, scanI2CBus and discoverDevices (write, Count 0),
+ * @details and the ID read (CIDR1 and CIDR2, Count 2) of devices other than the current one made by discoverDevices.
+ * @details Sending the trace takes time too; use a fast output (high baud rate, SD card file).
+ * @details Replay it with extras/tools/qn800x_trace_replay.py. Enable the trace with QN800X_FEATURE_TRACE.
+ * @param out where to send the trace (Serial, SD file...) or NULL to stop
+ * @code
+ * File trace = SD.open("trace.bin", FILE_WRITE);
+ * dv.setTrace(&trace);
+ * @endcode
+ */
+void QN800X::setTrace(Print *out) {
+  this->traceOut = out;
+  if (out) {
+    out->write('Q');
+    out->write('T');
+    out->write(2);
+    this->traceLast = micros();
+  }
+}
+
+/**
+ * @ingroup group02 I2C
+ * @brief Sends a transaction record to the trace (see setTrace)
+ */
+void QN800X::traceTransaction(uint8_t registerNumber, const uint8_t *data, uint8_t count, bool isRead, uint8_t error, uint32_t start, bool probe) {
+  uint32_t duration = micros() - start;
+  this->traceOut->write((uint8_t)((isRead ? 0 : 1) | ((error != QN800X_I2C_OK) ? 2 : 0) | (probe ? 4 : 0)));
+  this->traceOut->write(registerNumber);
+  this->traceOut->write(count);
+  traceVarint(this->traceOut, start - this->traceLast);
+  traceVarint(this->traceOut, duration);
+  if (error != QN800X_I2C_OK)
+    this->traceOut->write(error);
+  if (!isRead || error == QN800X_I2C_OK)
+    this->traceOut->write(data, count);
+  this->traceLast = start;
+}
+#endif
+
+/**
+ * @ingroup group02 I2C
+ * @brief Reads a register and reports the I2C result
+ * @details Unlike getRegister, this function tells the caller whether the value is valid.
+ * @param registerNumber register address
+ * @param value pointer to the variable that receives the register content (not changed on error)
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X_I2C_ERR_* codes
+ * @code
+ * uint8_t value;
+ * if (dv.readRegister(QN_SYSTEM1, &value) != QN800X_I2C_OK) {
+ *   // Handle the error
+ * }
+ * @endcode
+ */
+uint8_t QN800X::readRegister(uint8_t registerNumber, uint8_t *value) {
+  uint8_t data;
+  uint8_t error = this->transfer(registerNumber, &data, 1, true);
+  if (error == QN800X_I2C_OK)
+    *value = data;
+  return error;
+}
+
+/**
+ * @ingroup group02 I2C
+ * @brief Writes a register and reports the I2C result
+ * @param registerNumber register address
+ * @param value new register content
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X_I2C_ERR_* codes
+ */
+uint8_t QN800X::writeRegister(uint8_t registerNumber, uint8_t value) {
+  return this->transfer(registerNumber, &value, 1, false);
+}
+
+/**
+ * @ingroup group02 I2C
+ * @brief Gets register information
+ * @details QN800X commands. It provides a means to run commands that are not currently supported by the standard API.
+ * @details On I2C error this function returns 0xFF. Use getLastI2CError or readRegister to check the result.
+ * @param registerNumber
+ * @return uint8_t Value of the register
+ */
+uint8_t QN800X::getRegister(uint8_t registerNumber) {
+  uint8_t value = 0xFF;
+  this->readRegister(registerNumber, &value);
+  return value;
+}
+
+/**
+ * @ingroup group02 I2C
+ * @brief Stores a velue to a given register
+ * @details QN800X commands. It provides a means to run commands that are not currently supported by the standard API.
+ * @details Use getLastI2CError or writeRegister to check the result.
+ * @param registerNumber
+ * @param value
+ */
+void QN800X::setRegister(uint8_t registerNumber, uint8_t value) {
+  this->writeRegister(registerNumber, value);
+}
+
+/**
+ * @ingroup group02 I2C
+ * @brief Frees a stuck I2C bus
+ * @details If a transaction was interrupted (MCU reset, noise), the device may hold SDA low waiting for clocks.
+ * @details This function releases the Wire pins, sends up to nine SCL pulses until SDA is released,
+ * @details generates a STOP condition and restarts Wire. The I2C clock returns to the Wire default (100kHz).
+ * @details The pins come from PIN_WIRE_SDA/PIN_WIRE_SCL or from setI2CRecoveryPins.
+ * @return true if SDA is released; false if the bus is still stuck or the pins are unknown.
+ * @see setI2CRecoveryPins
+ */
+bool QN800X::recoverI2CBus() {
+
+  if (this->i2cSdaPin < 0 || this->i2cSclPin < 0)
+    return false;
+
+#if defined(WIRE_HAS_END) || defined(ARDUINO_ARCH_ESP32)
+  Wire.end();
+#endif
+
+  pinMode(this->i2cSdaPin, INPUT);
+  pinMode(this->i2cSclPin, INPUT);
+
+  for (uint8_t i = 0; i < 9 && digitalRead(this->i2cSdaPin) == LOW; i++) {
+    digitalWrite(this->i2cSclPin, LOW);
+    pinMode(this->i2cSclPin, OUTPUT);
+    delayMicroseconds(5);
+    pinMode(this->i2cSclPin, INPUT);
+    delayMicroseconds(5);
+  }
+
+  // STOP condition: SDA goes from low to high while SCL is high
+  digitalWrite(this->i2cSdaPin, LOW);
+  pinMode(this->i2cSdaPin, OUTPUT);
+  delayMicroseconds(5);
+  pinMode(this->i2cSdaPin, INPUT);
+  delayMicroseconds(5);
+
+  bool released = (digitalRead(this->i2cSdaPin) == HIGH);
+
+  Wire.begin();
+  this->setI2CRetryPolicy(this->i2cMaxRetries, this->i2cBackoff, this->i2cTimeout);
+
+  return released;
+}
+
+/**
+ * @ingroup group02 I2C
+ * @brief Sets how the register access functions handle I2C errors
+ * @details The worst-case latency of a register access depends on these values (see getI2CWorstCaseLatency).
+ * @details The timeout is applied to Wire on platforms that support it (AVR with WIRE_HAS_TIMEOUT and ESP32).
+ * @param maxRetries extra attempts after a failed transaction (0 = no retry)
+ * @param backoff delay in us before the first retry. It doubles on every new attempt.
+ * @param timeout Wire timeout in us
+ */
+void QN800X::setI2CRetryPolicy(uint8_t maxRetries, uint16_t backoff, uint32_t timeout) {
+  this->i2cMaxRetries = maxRetries;
+  this->i2cBackoff = backoff;
+  this->i2cTimeout = timeout;
+  this->applyWireTimeout(timeout);
+}
+
+/**
+ * @ingroup group02 I2C
+ * @brief Sets the Wire timeout on platforms that support it (AVR with WIRE_HAS_TIMEOUT and ESP32)
+ * @param timeout Wire timeout in us
+ */
+void QN800X::applyWireTimeout(uint32_t timeout) {
+#if defined(WIRE_HAS_TIMEOUT)
+  Wire.setWireTimeout(timeout, true);
+#elif defined(ARDUINO_ARCH_ESP32)
+  Wire.setTimeOut((uint16_t)((timeout + 999) / 1000));
+#else
+  (void)timeout;
+#endif
+}
+
+/**
+ * @ingroup group02 I2C
+ * @brief Estimates the worst-case time of a single register access
+ * @details Considers all attempts timing out (address and data phases), the command delay,
+ * @details the bus recovery and the backoff delays configured by setI2CRetryPolicy.
+ * @details The bus recovery cost (QN800X_I2C_RECOVERY_TIME) is derived from its pulse loop with a margin of
+ * @details QN800X_I2C_PIN_TIME per pin call; on slower cores (or a slow Wire.begin), raise those values.
+ * @details Without a Wire timeout (cores other than AVR with WIRE_HAS_TIMEOUT and ESP32), a stuck bus blocks
+ * @details Wire forever and there is no bound: the function returns 0.
+ * @return uint32_t time in us or 0 (unbounded)
+ */
+uint32_t QN800X::getI2CWorstCaseLatency() {
+#if defined(WIRE_HAS_TIMEOUT) || defined(ARDUINO_ARCH_ESP32)
+  uint32_t latency = 0;
+  uint16_t backoff = this->i2cBackoff;
+
+  for (uint8_t attempt = 0; attempt <= this->i2cMaxRetries; attempt++) {
+    latency += 2 * this->i2cTimeout + QN800X_DELAY_COMMAND;
+    if (attempt < this->i2cMaxRetries) {
+      latency += QN800X_I2C_RECOVERY_TIME + backoff;
+      backoff = (backoff < QN800X_I2C_BACKOFF_MAX / 2) ? backoff * 2 : QN800X_I2C_BACKOFF_MAX;
+    }
+  }
+  return latency;
+#else
+  return 0;
+#endif
+}
+
+
+/** @defgroup group03 Register cache and batch*/
+
+/**
+ * @ingroup group03 Register cache
+ * @brief Checks if a register can be kept in RAM
+ * @details Registers 00h to 19h without the QN800X_REG_VOLATILE attribute are cached (see QN800X_REG_MAP).
+ * @param registerNumber register address
+ * @return true if the register content can be cached
+ */
+bool QN800X::isCacheable(uint8_t registerNumber) {
+  return registerNumber < QN800X_SHADOW_SIZE && (QN800X_CACHE_MASK & ((uint32_t)1 << registerNumber));
+}
+
+/**
+ * @ingroup group03 Register cache
+ * @brief Checks if a write to a range of registers needs settling time
+ * @details A settling register with command bits (SYSTEM2) starts an internal process only when a command bit (SWRST, RECAL) is set.
+ * @details Mode requests (SYSTEM1) and channel changes have no fixed delay; the callers poll the device status instead.
+ * @param firstRegister address of the first register
+ * @param data values written
+ * @param count number of registers
+ * @return true if any register has the QN800X_REG_SETTLING attribute
+ */
+bool QN800X::needsSettling(uint8_t firstRegister, const uint8_t *data, uint8_t count) {
+  qn800x_reg_info info;
+  for (uint8_t reg = firstRegister; reg < firstRegister + count; reg++) {
+    if (reg < 32 && (QN800X_SETTLING_MASK & QN800X_COMMAND_MASK & ((uint32_t)1 << reg))) {
+      if (data[reg - firstRegister] & this->getCommandBits(reg))
+        return true;
+    } else if (reg < 32) {
+      if (QN800X_SETTLING_MASK & ((uint32_t)1 << reg))
+        return true;
+    } else if (this->getRegisterInfo(reg, &info) && (info.flags & QN800X_REG_SETTLING)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @ingroup group03 Register cache
+ * @brief Returns the self-clearing command bits of a register (CHSC in SYSTEM1; SWRST and RECAL in SYSTEM2)
+ * @details These bits are removed from the cached value, so a read-modify-write never repeats the command.
+ * @param registerNumber register address
+ * @return uint8_t command bits (commandMask of QN800X_REG_MAP) or 0
+ */
+uint8_t QN800X::getCommandBits(uint8_t registerNumber) {
+  qn800x_reg_info info;
+  if (registerNumber >= 32 || !(QN800X_COMMAND_MASK & ((uint32_t)1 << registerNumber)) || !this->getRegisterInfo(registerNumber, &info))
+    return 0;
+  return info.commandMask;
+}
+
+/**
+ * @ingroup group03 Register cache
+ * @brief Gets the attributes of a register from the register map
+ * @param registerNumber register address
+ * @param info receives the register map entry
+ * @return true if the register is in the map
+ */
+bool QN800X::getRegisterInfo(uint8_t registerNumber, qn800x_reg_info *info) {
+  for (uint8_t i = 0; i < QN800X_REG_COUNT; i++) {
+    if (pgm_read_byte(&QN800X_REG_MAP[i].address) == registerNumber) {
+      memcpy_P(info, &QN800X_REG_MAP[i], sizeof(qn800x_reg_info));
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @ingroup group03 Register cache
+ * @brief Reads all configuration registers (00h to 19h) in a single burst
+ * @param snapshot receives the register contents
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X_I2C_ERR_* codes
+ */
+uint8_t QN800X::saveSnapshot(qn800x_snapshot *snapshot) {
+  return this->readRegisters(QN_SYSTEM1, snapshot->raw, QN800X_SHADOW_SIZE);
+}
+
+/**
+ * @ingroup group03 Register cache
+ * @brief Writes back a snapshot taken by saveSnapshot
+ * @details Only writable, non volatile registers are written (see QN800X_REG_MAP). Registers that already
+ * @details have the snapshot value (cached) are skipped. Self-clearing command bits (CHSC, SWRST and RECAL) are
+ * @details cleared, so a snapshot taken during a scan or a calibration does not start it again.
+ * @param snapshot register contents
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X_I2C_ERR_* codes
+ */
+uint8_t QN800X::loadSnapshot(const qn800x_snapshot *snapshot) {
+  QN800XBatch batch(*this);
+  for (uint8_t reg = 0; reg < QN800X_SHADOW_SIZE; reg++) {
+    if (QN800X_RESTORE_MASK & ((uint32_t)1 << reg))
+      batch.setRegister(reg, snapshot->raw[reg] & ~this->getCommandBits(reg));
+  }
+  return batch.commit();
+}
+
+/**
+ * @ingroup group03 Register cache
+ * @brief Prints all registers of the map with their attributes
+ * @details Registers 00h to 22h are read with readRegisters: one burst when the Wire buffer holds 35 bytes, otherwise
+ * @details one read per buffer (two on AVR, whose buffer has 32 bytes). The other registers are read one by one.
+ * @details Names, reset values and attributes come from QN800X_REG_MAP.
+ * @details Each line shows: address, name, value, reset value and attributes (W = writable, V = volatile, S = settling).
+ * @details A "*" marks values different from the reset value.
+ * @param out where to print. Example: Serial
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X_I2C_ERR_* codes
+ * @code
+ * dv.dumpRegisters(Serial);
+ * @endcode
+ */
+uint8_t QN800X::dumpRegisters(Print &out) {
+  uint8_t block[QN_SNR + 1];
+  uint8_t error;
+  qn800x_reg_info info;
+
+  if ((error = this->readRegisters(QN_SYSTEM1, block, sizeof(block))) != QN800X_I2C_OK)
+    return error;
+
+  for (uint8_t i = 0; i < QN800X_REG_COUNT; i++) {
+    uint8_t value;
+    memcpy_P(&info, &QN800X_REG_MAP[i], sizeof(info));
+    if (info.address < sizeof(block))
+      value = block[info.address];
+    else if ((error = this->readRegister(info.address, &value)) != QN800X_I2C_OK)
+      return error;
+
+    out.print((info.address < 0x10) ? "0" : "");
+    out.print(info.address, HEX);
+    out.print(' ');
+    out.print(info.name);
+    for (uint8_t n = strlen(info.name); n < 9; n++)
+      out.print(' ');
+    out.print((value < 0x10) ? "0" : "");
+    out.print(value, HEX);
+    out.print((value != info.resetValue && !(info.flags & QN800X_REG_VOLATILE)) ? "* " : "  ");
+    out.print((info.resetValue < 0x10) ? "0" : "");
+    out.print(info.resetValue, HEX);
+    out.print(' ');
+    out.print((info.writeMask) ? 'W' : '-');
+    out.print((info.flags & QN800X_REG_VOLATILE) ? 'V' : '-');
+    out.println((info.flags & QN800X_REG_SETTLING) ? 'S' : '-');
+  }
+  return QN800X_I2C_OK;
+}
+
+/**
+ * @ingroup group03 Register cache
+ * @brief Reads consecutive registers using burst reads
+ * @details The device increments the register address after each byte. A single I2C transaction is used
+ * @details when count fits in the Wire buffer (QN800X_I2C_BUFFER).
+ * @param firstRegister address of the first register
+ * @param values buffer that receives the register contents
+ * @param count number of registers
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X_I2C_ERR_* codes
+ */
+uint8_t QN800X::readRegisters(uint8_t firstRegister, uint8_t *values, uint8_t count) {
+  uint8_t error = QN800X_I2C_OK;
+  for (uint8_t done = 0; done < count && error == QN800X_I2C_OK; done += QN800X_I2C_BUFFER) {
+    uint8_t size = (count - done < QN800X_I2C_BUFFER) ? count - done : QN800X_I2C_BUFFER;
+    error = this->transfer(firstRegister + done, values + done, size, true);
+  }
+  return error;
+}
+
+/**
+ * @ingroup group03 Register cache
+ * @brief Writes consecutive registers using burst writes
+ * @details A single I2C transaction is used when count fits in the Wire buffer (QN800X_I2C_BUFFER - 1).
+ * @param firstRegister address of the first register
+ * @param values register contents
+ * @param count number of registers
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X_I2C_ERR_* codes
+ */
+uint8_t QN800X::writeRegisters(uint8_t firstRegister, const uint8_t *values, uint8_t count) {
+  uint8_t error = QN800X_I2C_OK;
+  for (uint8_t done = 0; done < count && error == QN800X_I2C_OK; done += QN800X_I2C_BUFFER - 1) {
+    uint8_t size = (count - done < QN800X_I2C_BUFFER - 1) ? count - done : QN800X_I2C_BUFFER - 1;
+    error = this->transfer(firstRegister + done, (uint8_t *)values + done, size, false);
+  }
+  return error;
+}
+
+/**
+ * @ingroup group03 Register cache
+ * @brief Gets a register content from RAM, reading the device only if it is not cached yet
+ * @param registerNumber register address
+ * @param value pointer to the variable that receives the register content
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X_I2C_ERR_* codes
+ */
+uint8_t QN800X::getCachedRegister(uint8_t registerNumber, uint8_t *value) {
+  if (this->isCacheable(registerNumber) && (this->shadowValid & ((uint32_t)1 << registerNumber))) {
+    *value = this->shadow[registerNumber];
+    return QN800X_I2C_OK;
+  }
+  return this->readRegister(registerNumber, value);
+}
+
+/**
+ * @ingroup group03 Register cache
+ * @brief Writes back all configuration registers kept in RAM
+ * @details Useful when the device lost its configuration (for example, after a power failure).
+ * @details Registers are sent as burst writes in address order and SYSTEM1 is written last.
+ * @details Self-clearing command bits (CHSC, SWRST and RECAL) are never sent.
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X_I2C_ERR_* codes
+ */
+uint8_t QN800X::restoreRegisters() {
+  uint8_t error;
+
+  for (uint8_t reg = QN_SYSTEM2; reg < QN800X_SHADOW_SIZE;) {
+    uint8_t first = reg;
+    while (reg < QN800X_SHADOW_SIZE && (this->shadowValid & QN800X_RESTORE_MASK & ((uint32_t)1 << reg)))
+      reg++;
+    if (reg > first) {
+      uint8_t values[QN800X_SHADOW_SIZE];
+      // Do not reset or recalibrate the device again
+      for (uint8_t i = first; i < reg; i++)
+        values[i - first] = this->shadow[i] & ~this->getCommandBits(i);
+      if ((error = this->writeRegisters(first, values, reg - first)) != QN800X_I2C_OK)
+        return error;
+    } else {
+      reg++;
+    }
+  }
+
+  if (this->shadowValid & ((uint32_t)1 << QN_SYSTEM1))
+    return this->writeRegister(QN_SYSTEM1, this->shadow[QN_SYSTEM1] & ~this->getCommandBits(QN_SYSTEM1));
+  return QN800X_I2C_OK;
+}
+
+/**
+ * @ingroup group03 Register cache
+ * @brief Gets the value a register will have after commit
+ * @param registerNumber register address (00h to 19h)
+ * @return uint8_t pending value, cached value or 0xFF if the register could not be read
+ */
+uint8_t QN800XBatch::get(uint8_t registerNumber) {
+  uint8_t content = 0xFF;
+  if (registerNumber >= QN800X_SHADOW_SIZE)
+    return content;
+  if (this->touched & ((uint32_t)1 << registerNumber))
+    return this->value[registerNumber];
+  this->device->getCachedRegister(registerNumber, &content);
+  return content;
+}
+
+/**
+ * @ingroup group03 Register cache
+ * @brief Sets the whole content of a register
+ * @param registerNumber register address (00h to 19h; read only registers are rejected)
+ * @param value new register content
+ * @return uint8_t QN800X_I2C_OK or QN800X_ERR_INVALID_REGISTER if the register cannot be part of a batch
+ */
+uint8_t QN800XBatch::setRegister(uint8_t registerNumber, uint8_t value) {
+  if (registerNumber >= QN800X_SHADOW_SIZE || !(QN800X_WRITABLE_MASK & ((uint32_t)1 << registerNumber)))
+    return QN800X_ERR_INVALID_REGISTER;
+  this->value[registerNumber] = value;
+  this->touched |= (uint32_t)1 << registerNumber;
+  return QN800X_I2C_OK;
+}
+
+/**
+ * @ingroup group03 Register cache
+ * @brief Sets some bits of a register
+ * @details The other bits come from the pending value or from the content kept in RAM (read once if needed).
+ * @param registerNumber register address (00h to 19h)
+ * @param mask bits to be changed
+ * @param value new bits (in the register position)
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X_I2C_ERR_* codes
+ */
+uint8_t QN800XBatch::setField(uint8_t registerNumber, uint8_t mask, uint8_t value) {
+  uint8_t content;
+  if (registerNumber >= QN800X_SHADOW_SIZE)
+    return QN800X_ERR_INVALID_REGISTER;
+  if (this->touched & ((uint32_t)1 << registerNumber)) {
+    content = this->value[registerNumber];
+  } else {
+    uint8_t error = this->device->getCachedRegister(registerNumber, &content);
+    if (error != QN800X_I2C_OK)
+      return error;
+  }
+  return this->setRegister(registerNumber, (content & ~mask) | (value & mask));
+}
+
+/**
+ * @ingroup group03 Register cache
+ * @brief Sends the pending updates to the device
+ * @details Registers whose pending value is equal to the cached one are dropped. The others are written in
+ * @details address order using as few burst writes as possible: a burst may rewrite up to QN800X_BATCH_MAX_GAP unchanged
+ * @details cached registers to join two bursts, but never a register with the QN800X_REG_SETTLING attribute (that would
+ * @details add QN800X_DELAY_COMMAND and may restart a calibration). SYSTEM1 is written at the end, so the mode
+ * @details request is processed with the new configuration. The batch is empty after a successful commit.
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X_I2C_ERR_* codes (pending updates are kept on error)
+ */
+uint8_t QN800XBatch::commit() {
+  uint8_t  buffer[QN800X_SHADOW_SIZE];
+  uint32_t dirty = 0;
+  uint8_t  error;
+
+  this->transactions = 0;
+
+  for (uint8_t reg = 0; reg < QN800X_SHADOW_SIZE; reg++) {
+    uint32_t bit = (uint32_t)1 << reg;
+    if ((this->touched & bit) && (!(this->device->shadowValid & bit) || !this->device->isCacheable(reg) || this->device->shadow[reg] != this->value[reg]))
+      dirty |= bit;
+  }
+
+  for (uint8_t reg = QN_SYSTEM2; reg < QN800X_SHADOW_SIZE;) {
+    if (!(dirty & ((uint32_t)1 << reg))) {
+      reg++;
+      continue;
+    }
+    uint8_t first = reg, last = reg;
+    for (uint8_t next = reg + 1; next < QN800X_SHADOW_SIZE && next - last <= QN800X_BATCH_MAX_GAP + 1; next++) {
+      uint32_t bit = (uint32_t)1 << next;
+      if (dirty & bit)
+        last = next;
+      else if (!(this->device->shadowValid & QN800X_RESTORE_MASK & ~QN800X_SETTLING_MASK & bit))
+        break;
+    }
+    for (uint8_t i = first; i <= last; i++)
+      buffer[i - first] = (this->touched & ((uint32_t)1 << i)) ? this->value[i] : this->device->shadow[i];
+    if ((error = this->device->writeRegisters(first, buffer, last - first + 1)) != QN800X_I2C_OK)
+      return error;
+    this->transactions++;
+    reg = last + 1;
+  }
+
+  if (dirty & ((uint32_t)1 << QN_SYSTEM1)) {
+    if ((error = this->device->writeRegister(QN_SYSTEM1, this->value[QN_SYSTEM1])) != QN800X_I2C_OK)
+      return error;
+    this->transactions++;
+  }
+
+  this->touched = 0;
+  return QN800X_I2C_OK;
+}
+
+/**
+ * @ingroup group02 I2C
+ * @brief Gets de device ID
+ * @details Gets the Chip ID for product family (CID1) and Chip ID for minor revision (CID2)
+ * @details The register is read once and then kept in RAM (see discoverDevices).
+ * @details See CIDR1 register (Address 0x05 - Datasheet page 36)   
+ * @param value
+ */
+qn800x_cidr1 QN800X::getDeviceProductID() {
+    qn800x_cidr1 value;
+    if (this->getCachedRegister(QN_CIDR1, &value.raw) != QN800X_I2C_OK)
+      value.raw = 0xFF;
+    return value;
+};
+
+
+/**
+ * @ingroup group02 I2C
+ * @brief Gets de device ID
+ * @details Gets the Chip ID for product ID (CID3) and Chip ID for major revision (CID4)
+ * @details The register is read once and then kept in RAM (see discoverDevices).
+ * @details See CIDR2 register (Address 0x06 - Datasheet page 37)
+ * @param value
+ */
+qn800x_cidr2 QN800X::getDeviceProductFamily() {
+    qn800x_cidr2 value;
+    if (this->getCachedRegister(QN_CIDR2, &value.raw) != QN800X_I2C_OK)
+      value.raw = 0xFF;
+    return value;
+}
+
+/**
+ * @ingroup group02 I2C
+ * @brief Decodes the part from the product ID (CID3)
+ * @details See CIDR2 in the QN8006 (page 37) and QN8007 (page 31) datasheets.
+ * @param cidr2 CIDR2 register
+ * @return uint8_t one of the QN800X_PART_* values
+ */
+uint8_t QN800X::decodePart(qn800x_cidr2 cidr2) {
+  switch (cidr2.arg.CID3) {
+    case 0b0011:
+      return QN800X_PART_QN8006;
+    case 0b0111:
+      return QN800X_PART_QN8006L;
+    case 0b0001:
+      return QN800X_PART_QN8007;
+    case 0b0101:
+      return QN800X_PART_QN8007L;
+    default:
+      return QN800X_PART_UNKNOWN;
+  }
+}
+
+
+/** @defgroup group04 Tune*/
+
+/**
+ * @ingroup group04 Tune
+ * @brief Sets the 10-bit channel index used for TX/RX
+ * @details Channel frequency is (76 + channel * 0.05) MHz. The channel is used when CCA_CH_DIS (SYSTEM1) is 1.
+ * @details The lower 8 bits are in QN_CH and the highest 2 bits in QN_CH_STEP. When the highest bits do not change,
+ * @details only QN_CH is written. Otherwise both registers are sent in a single burst.
+ * @details The time spent is available in getTuneLatency.
+ * @param channel 10-bit channel index (0 to 1023)
+ * @param waitSettling if true, waits for the RX AGC to settle (RX mode only)
+ * @return uint8_t QN800X_I2C_OK, QN800X_ERR_INVALID_ARGUMENT (channel above 1023) or one of the QN800X error codes
+ */
+uint8_t QN800X::setChannel(uint16_t channel, bool waitSettling) {
+  if (channel > 1023)
+    return QN800X_ERR_INVALID_ARGUMENT;
+  return this->tune((uint8_t)channel, channel >> 8, waitSettling);
+}
+
+/**
+ * @ingroup group04 Tune
+ * @brief Writes a channel already split into QN_CH and the CH field of QN_CH_STEP (see setChannel and hopTo)
+ * @details No fixed delay follows the channel change. The settling is detected by polling RXAGCSET (STATUS1).
+ * @details The device has no TX status bit, so in TX mode the latency is the bus time only.
+ * @param ch lower 8 bits of the channel index
+ * @param chHigh highest 2 bits of the channel index
+ * @param waitSettling if true, waits for the RX AGC to settle (RX mode only)
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X error codes
+ */
+uint8_t QN800X::tune(uint8_t ch, uint8_t chHigh, bool waitSettling) {
+
+  uint8_t error, current, chStep;
+#if QN800X_FEATURE_TELEMETRY
+  uint32_t start = micros();
+#endif
+
+  if ((error = this->getCachedRegister(QN_CH_STEP, &chStep)) != QN800X_I2C_OK)
+    return error;
+
+  if ((chStep & 0b00000011) == chHigh) {
+    if (this->getCachedRegister(QN_CH, &current) != QN800X_I2C_OK || current != ch)
+      error = this->writeRegister(QN_CH, ch);
+  } else {
+    QN800XBatch batch(*this);
+    batch.setRegister(QN_CH, ch);
+    batch.setRegister(QN_CH_STEP, (chStep & 0b11111100) | chHigh);
+    error = batch.commit();
+  }
+  if (error != QN800X_I2C_OK)
+    return error;
+
+  this->currentChannel = ((uint16_t)chHigh << 8) | ch;
+  this->currentFrequency = this->currentChannel / 2 + 760;
+
+#if QN800X_FEATURE_RX
+  if (waitSettling)
+    error = this->waitForRxReady();
+#else
+  (void)waitSettling;
+#endif
+
+#if QN800X_FEATURE_TELEMETRY
+  this->tuneLatency = micros() - start;
+#endif
+  return error;
+}
+
+/**
+ * @ingroup group04 Tune
+ * @brief Sets the TX/RX frequency
+ * @param frequency frequency in 100kHz units. Example: 1069 means 106.9MHz
+ * @param waitSettling if true, waits for the RX AGC to settle (RX mode only)
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X error codes
+ * @see setChannel
+ */
+uint8_t QN800X::setFrequency(uint16_t frequency, bool waitSettling) {
+  return this->setChannel((frequency - 760) * 2, waitSettling);
+}
+
+#if QN800X_FEATURE_RX
+/**
+ * @ingroup group04 Tune
+ * @brief Waits for the receiver to be ready by polling RXAGCSET (STATUS1)
+ * @param timeout maximum time in ms
+ * @return uint8_t QN800X_I2C_OK, QN800X_ERR_NOT_READY or one of the QN800X_I2C_ERR_* codes
+ */
+uint8_t QN800X::waitForRxReady(uint16_t timeout) {
+  qn800x_status1 status;
+  uint8_t error;
+  uint32_t start = millis();
+
+  do {
+    if ((error = this->readRegister(QN_STATUS1, &status.raw)) != QN800X_I2C_OK)
+      return error;
+    if (status.arg.RXAGCSET)
+      return QN800X_I2C_OK;
+  } while (millis() - start < timeout);
+
+  return QN800X_ERR_NOT_READY;
+}
+
+/**
+ * @ingroup group04 Tune
+ * @brief Gets the in-band RSSI and the estimated CNR of the current channel
+ * @details RSSISIG (1Ch) and SNR (22h) are read in a single burst.
+ * @param rssi receives the in-band signal RSSI (dBuV)
+ * @param snr receives the estimated RF input CNR (dB)
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X_I2C_ERR_* codes
+ */
+uint8_t QN800X::getSignalQuality(uint8_t *rssi, uint8_t *snr) {
+  uint8_t block[QN_SNR - QN_RSSISIG + 1];
+  uint8_t error = this->readRegisters(QN_RSSISIG, block, sizeof(block));
+  if (error == QN800X_I2C_OK) {
+    *rssi = block[0];
+    *snr = block[QN_SNR - QN_RSSISIG];
+  }
+  return error;
+}
+#endif
+
+
+/**
+ * @ingroup group99 Helper and Tools functions
+ * @brief Updates a CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF) with one byte
+ */
+static inline uint16_t crc16Update(uint16_t crc, uint8_t value) {
+  crc ^= (uint16_t)value << 8;
+  for (uint8_t i = 0; i < 8; i++)
+    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  return crc;
+}
+
+
+#if QN800X_FEATURE_SCAN
+/** @defgroup group08 Scan*/
+
+/**
+ * @ingroup group08 Scan
+ * @brief Updates the frame CRC with one byte and sends the byte
+ */
+static void sweepPut(Print &out, uint16_t &crc, uint8_t value) {
+  crc = crc16Update(crc, value);
+  out.write(value);
+}
+
+/**
+ * @ingroup group08 Scan
+ * @brief Scans a channel range and sends the RSSI and SNR of each channel as a compact binary frame
+ * @details The device must be in RX mode. Use it in a loop for continuous (waterfall) monitoring.
+ * @details The frame is sent while the sweep runs, so no buffer is needed. Frame layout (multi-byte fields are little endian):
+ * | Field          | Size | Description                                                           |
+ * | -------------- | ---- | --------------------------------------------------------------------- |
+ * | Sync           | 2    | 0x51 0x53 ("QS")                                                      |
+ * | Version        | 1    | 1                                                                     |
+ * | First channel  | 2    | 10-bit channel index. Frequency is (76 + channel * 0.05) MHz          |
+ * | Step           | 1    | Channel step                                                          |
+ * | Count          | 2    | Number of channels                                                    |
+ * | Samples        | n    | First channel: RSSI and SNR bytes. Next channels: one byte with the   |
+ * |                |      | RSSI delta (high nibble) and SNR delta (low nibble), -7 to 7, or 0x88 |
+ * |                |      | followed by the RSSI and SNR bytes when a delta does not fit          |
+ * | CRC            | 2    | CRC-16/CCITT (init 0xFFFF) of all previous bytes                      |
+ * @details The reference decoder is extras/tools/qn800x_sweep_decode.py
+ * @param firstChannel first 10-bit channel index
+ * @param lastChannel last 10-bit channel index
+ * @param step channel step (1 = 50kHz, 2 = 100kHz, 4 = 200kHz)
+ * @param out where to send the frame. Example: Serial
+ * @param settling maximum time in ms waiting for the RX AGC on each channel
+ * @return uint8_t QN800X_I2C_OK, QN800X_ERR_INVALID_ARGUMENT (step is 0, lastChannel is below firstChannel or above 1023;
+ * @return nothing is sent) or one of the QN800X_I2C_ERR_* codes (the frame is truncated and has no CRC on error)
+ * @code
+ * void loop() {
+ *   rx.sweep(280, 640, 2, Serial);   // 90 to 108 MHz, 100kHz step
+ * }
+ * @endcode
+ */
+uint8_t QN800X::sweep(uint16_t firstChannel, uint16_t lastChannel, uint8_t step, Print &out, uint16_t settling) {
+  uint16_t crc = 0xFFFF;
+  uint8_t rssi, snr, lastRssi = 0, lastSnr = 0;
+  uint8_t error;
+
+  if (step == 0 || lastChannel < firstChannel || lastChannel > 1023)
+    return QN800X_ERR_INVALID_ARGUMENT;
+  uint16_t count = (lastChannel - firstChannel) / step + 1;
+
+  sweepPut(out, crc, 0x51);
+  sweepPut(out, crc, 0x53);
+  sweepPut(out, crc, 1);
+  sweepPut(out, crc, (uint8_t)firstChannel);
+  sweepPut(out, crc, (uint8_t)(firstChannel >> 8));
+  sweepPut(out, crc, step);
+  sweepPut(out, crc, (uint8_t)count);
+  sweepPut(out, crc, (uint8_t)(count >> 8));
+
+  for (uint16_t i = 0; i < count; i++) {
+    if ((error = this->setChannel(firstChannel + i * step)) != QN800X_I2C_OK)
+      return error;
+    this->waitForRxReady(settling);
+    if ((error = this->getSignalQuality(&rssi, &snr)) != QN800X_I2C_OK)
+      return error;
+
+    int16_t deltaRssi = (int16_t)rssi - lastRssi;
+    int16_t deltaSnr = (int16_t)snr - lastSnr;
+    if (i > 0 && deltaRssi >= -7 && deltaRssi <= 7 && deltaSnr >= -7 && deltaSnr <= 7) {
+      sweepPut(out, crc, (uint8_t)(((deltaRssi & 0x0F) << 4) | (deltaSnr & 0x0F)));
+    } else {
+      if (i > 0)
+        sweepPut(out, crc, 0x88);
+      sweepPut(out, crc, rssi);
+      sweepPut(out, crc, snr);
+    }
+    lastRssi = rssi;
+    lastSnr = snr;
+  }
+
+  uint16_t frameCrc = crc;
+  out.write((uint8_t)frameCrc);
+  out.write((uint8_t)(frameCrc >> 8));
+  return QN800X_I2C_OK;
+}
+
+#if QN800X_FEATURE_RDS_RX
+/**
+ * @ingroup group08 Scan
+ * @brief Scans a channel range and identifies each station found by its PI
+ * @details A channel is occupied when its RSSI is at least minRssi. For each occupied channel, the scan waits
+ * @details only for the first valid PI (see rdsWaitPI) and moves on; channels without RDS cost at most piTimeout.
+ * @details The device must be in RX mode with RDS enabled (RDSEN).
+ * @param firstChannel first 10-bit channel index
+ * @param lastChannel last 10-bit channel index
+ * @param step channel step (1 = 50kHz, 2 = 100kHz, 4 = 200kHz)
+ * @param minRssi minimum RSSI (dBuV) of an occupied channel
+ * @param stations receives the stations found, in channel order
+ * @param maxStations size of stations. The scan stops when it is full
+ * @param found receives the number of stations found
+ * @param piTimeout maximum time in ms waiting for the PI on each occupied channel
+ * @param settling maximum time in ms waiting for the RX AGC on each channel
+ * @return uint8_t QN800X_I2C_OK, QN800X_ERR_INVALID_ARGUMENT (step is 0, lastChannel is below firstChannel or above 1023)
+ * @return or one of the QN800X_I2C_ERR_* codes (found has the stations identified so far)
+ * @code
+ * qn800x_station stations[20];
+ * uint8_t count;
+ * rx.scanStations(280, 640, 2, 25, stations, 20, &count);   // 90 to 108 MHz, 100kHz step
+ * for (uint8_t i = 0; i < count; i++) {
+ *   Serial.print(stations[i].channel / 2 + 760);
+ *   Serial.print(" ");
+ *   Serial.println(stations[i].pi, HEX);
+ * }
+ * @endcode
+ */
+uint8_t QN800X::scanStations(uint16_t firstChannel, uint16_t lastChannel, uint8_t step, uint8_t minRssi, qn800x_station *stations, uint8_t maxStations, uint8_t *found, uint16_t piTimeout, uint16_t settling) {
+  uint8_t rssi, snr, error;
+
+  *found = 0;
+  if (step == 0 || lastChannel < firstChannel || lastChannel > 1023)
+    return QN800X_ERR_INVALID_ARGUMENT;
+  for (uint16_t channel = firstChannel; channel <= lastChannel && *found < maxStations; channel += step) {
+    if ((error = this->setChannel(channel)) != QN800X_I2C_OK)
+      return error;
+    this->waitForRxReady(settling);
+    if ((error = this->getSignalQuality(&rssi, &snr)) != QN800X_I2C_OK)
+      return error;
+    if (rssi < minRssi)
+      continue;
+
+    qn800x_station *station = &stations[(*found)++];
+    station->channel = channel;
+    station->rssi = rssi;
+    station->snr = snr;
+    station->pi = 0;
+    if ((error = this->rdsWaitPI(&station->pi, piTimeout)) != QN800X_I2C_OK && error != QN800X_ERR_NOT_READY)
+      return error;
+  }
+  return QN800X_I2C_OK;
+}
+#endif
+#endif
+
+/**
+ * @ingroup group04 Tune
+ * @brief Converts a list of frequencies to channels ready for hopTo
+ * @details Use it once (for example in setup) to remove the conversion work from the hopping loop.
+ * @param frequencies frequencies in 100kHz units
+ * @param table array that receives the channels (same size as frequencies)
+ * @param count number of frequencies
+ * @code
+ * const uint16_t beacon[] = {881, 1003, 1069};
+ * qn800x_hop hops[3];
+ * tx.buildHopTable(beacon, hops, 3);
+ * ...
+ * for (uint8_t i = 0; i < 3; i++) {
+ *   tx.hopTo(hops[i]);
+ *   ...
+ * }
+ * @endcode
+ */
+void QN800X::buildHopTable(const uint16_t *frequencies, qn800x_hop *table, uint8_t count) {
+  for (uint8_t i = 0; i < count; i++) {
+    uint16_t channel = (frequencies[i] - 760) * 2;
+    table[i].ch = (uint8_t)channel;
+    table[i].chHigh = (channel >> 8) & 0b00000011;
+  }
+}
+
+/**
+ * @ingroup group04 Tune
+ * @brief Switches to a channel of a hop table
+ * @details The table entry is written as it is: when the highest channel bits do not change, the hop is a single
+ * @details QN_CH write with no fixed delay. With waitSettling, the hop ends as soon as RXAGCSET (STATUS1) is set,
+ * @details so getTuneLatency gives the real switch-to-stable time in RX mode.
+ * @param hop channel built by buildHopTable
+ * @param waitSettling if true, waits for the RX AGC to settle (RX mode only)
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X error codes
+ * @see buildHopTable, getTuneLatency
+ */
+uint8_t QN800X::hopTo(const qn800x_hop &hop, bool waitSettling) {
+  return this->tune(hop.ch, hop.chHigh & 0b00000011, waitSettling);
+}
+
+
+#if QN800X_FEATURE_RDS_TX
+/** @defgroup group05 RDS TX*/
+
+/**
+ * @ingroup group05 RDS TX
+ * @brief Sends a RDS group
+ * @details Writes RDSD0 to RDSD7 in a single burst and toggles RDSTXRDY (SYSTEM2). The device fetches the new group
+ * @details after completing the transmission of the current one. Use isRdsGroupFetched before sending the next group.
+ * @param group group to be transmitted
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X_I2C_ERR_* codes
+ */
+uint8_t QN800X::rdsSendGroup(const qn800x_rds_group &group) {
+  qn800x_system2 system2;
+  qn800x_status3 status3;
+  uint8_t error;
+
+  if ((error = this->writeRegisters(QN_RDSD0, group.data, 8)) != QN800X_I2C_OK)
+    return error;
+  if ((error = this->readRegister(QN_STATUS3, &status3.raw)) != QN800X_I2C_OK)
+    return error;
+  this->rdsTxUpdate = status3.arg.RDS_RXTXUPD;
+
+  if ((error = this->getCachedRegister(QN_SYSTEM2, &system2.raw)) != QN800X_I2C_OK)
+    return error;
+  system2.arg.RDSTXRDY = !system2.arg.RDSTXRDY;
+  return this->writeRegister(QN_SYSTEM2, system2.raw);
+}
+
+/**
+ * @ingroup group05 RDS TX
+ * @brief Sends a RDS group stored in flash (PROGMEM)
+ * @param group pointer to the group in flash. Example: QN800X_RDS_PS_GROUPS array
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X_I2C_ERR_* codes
+ */
+uint8_t QN800X::rdsSendGroupFromFlash(const qn800x_rds_group *group) {
+  qn800x_rds_group buffer;
+  for (uint8_t i = 0; i < 8; i++)
+    buffer.data[i] = pgm_read_byte(&group->data[i]);
+  return this->rdsSendGroup(buffer);
+}
+
+/**
+ * @ingroup group05 RDS TX
+ * @brief Checks if the device has fetched the latest group sent by rdsSendGroup
+ * @details The device toggles RDS_RXTXUPD (STATUS3) when it loads a new group into the transmitting buffer.
+ * @return true if a new group can be sent without overwriting the previous one
+ */
+bool QN800X::isRdsGroupFetched() {
+  qn800x_status3 status3;
+  if (this->readRegister(QN_STATUS3, &status3.raw) != QN800X_I2C_OK)
+    return false;
+  return status3.arg.RDS_RXTXUPD != this->rdsTxUpdate;
 }
 
 /**
- * @ingroup group01 Scan I2C Devices
- * @brief  Scans the I2C bus and returns the addresses of the devices found.
- * @details Searches for devices connected to the I2C bus. The addresses of the devices found are stored in the "device" array.
- * @param device array of device addresses found.
- * @return uint8_t number of devices found or 0 if no device found or error.
+ * @ingroup group05 RDS TX
+ * @brief Constructor
+ * @param pi Program Identification
+ * @param pty Program Type code
+ * @param tp Traffic Program code
  */
-uint8_t QN800X::scanI2CBus(uint8_t *device) {
+QN800XRdsEncoder::QN800XRdsEncoder(uint16_t pi, uint8_t pty, bool tp) {
+  this->pi = pi;
+  this->pty = pty;
+  this->tp = tp;
+  memset(this->rt, ' ', sizeof(this->rt));
+  memset(this->ct, 0, sizeof(this->ct));
+}
 
-  int  error, address;
-  uint8_t idxDevice = 0;
+/**
+ * @ingroup group05 RDS TX
+ * @brief Sets the RadioText (up to 64 characters)
+ * @details Only the 4-character segments that differ from the current text are marked as pending.
+ * @details A text shorter than 64 characters is terminated by a carriage return.
+ * @param text new RadioText
+ * @param clear if true, toggles the A/B flag (receivers clear the display) and marks all segments as pending
+ */
+void QN800XRdsEncoder::setRT(const char *text, bool clear) {
+  uint8_t len = strnlen(text, sizeof(this->rt));
+  uint8_t segments = (len < sizeof(this->rt)) ? len / 4 + 1 : 16;
 
-  Wire.begin();
+  this->rtSegments = segments;
 
-  for (address = 1; address < 127; address++) {
-    Wire.beginTransmission(address);
-    error = Wire.endTransmission();
-    delayMicroseconds(200);
+  for (uint8_t i = 0; i < sizeof(this->rt); i++) {
+    char c = (i < len) ? text[i] : ((i == len) ? '\r' : ' ');
+    if (this->rt[i] != c) {
+      this->rt[i] = c;
+      if (i / 4 < segments)
+        this->pending |= (uint32_t)1 << (i / 4);
+    }
+  }
 
-    if (error == 0) {
-      device[idxDevice] = address;
-      idxDevice++;
-    } else if (error == 4) {
-      return 0;
+  if (clear) {
+    this->rtAB = !this->rtAB;
+    this->pending |= ((uint32_t)1 << segments) - 1;
+  }
+}
+
+/**
+ * @ingroup group05 RDS TX
+ * @brief Sets the Clock Time (group 4A)
+ * @details The group is marked as pending only if the time changed.
+ * @param mjd Modified Julian Day
+ * @param hour UTC hour (0 to 23)
+ * @param minute UTC minute (0 to 59)
+ * @param offset local time offset in multiples of half hours (-24 to 24)
+ */
+void QN800XRdsEncoder::setCT(uint32_t mjd, uint8_t hour, uint8_t minute, int8_t offset) {
+  uint16_t ct[3];
+  ct[0] = (mjd >> 15) & 0b11;
+  ct[1] = (uint16_t)((mjd & 0x7FFF) << 1) | ((hour >> 4) & 1);
+  ct[2] = (uint16_t)((hour & 0x0F) << 12) | ((minute & 0x3F) << 6) | ((offset < 0) << 5) | ((offset < 0 ? -offset : offset) & 0x1F);
+  if (memcmp(ct, this->ct, sizeof(ct)) != 0) {
+    memcpy(this->ct, ct, sizeof(ct));
+    this->pending |= (uint32_t)1 << 16;
+  }
+}
+
+/**
+ * @ingroup group05 RDS TX
+ * @brief Builds the 2A group of a RadioText segment
+ * @param segment segment address (0 to 15)
+ * @param group receives the group
+ */
+void QN800XRdsEncoder::getRTGroup(uint8_t segment, qn800x_rds_group &group) {
+  const char *text = &this->rt[(segment & 0x0F) * 4];
+  group = qn800xRdsGroup(this->pi, qn800xRdsBlock2(2, 0, this->tp, this->pty, ((this->rtAB ? 1 : 0) << 4) | (segment & 0x0F)),
+                         (uint16_t)(((uint8_t)text[0] << 8) | (uint8_t)text[1]),
+                         (uint16_t)(((uint8_t)text[2] << 8) | (uint8_t)text[3]));
+}
+
+/**
+ * @ingroup group05 RDS TX
+ * @brief Gets the next group to be transmitted
+ * @details Pending groups come first: the Clock Time, then the updated RadioText segments.
+ * @details When nothing is pending, the Program Service name groups (see setPS) and the RadioText segments are
+ * @details returned in turn, so the receivers keep getting the station data.
+ * @param group receives the group to be sent (see QN800X::rdsSendGroup)
+ * @return true if a group was returned; false if there is nothing to send (no PS groups and no RadioText)
+ */
+bool QN800XRdsEncoder::nextGroup(qn800x_rds_group &group) {
+
+  if (this->pending & ((uint32_t)1 << 16)) {
+    this->pending &= ~((uint32_t)1 << 16);
+    group = qn800xRdsGroup(this->pi, qn800xRdsBlock2(4, 0, this->tp, this->pty, this->ct[0]), this->ct[1], this->ct[2]);
+    return true;
+  }
+
+  for (uint8_t segment = 0; segment < 16; segment++) {
+    if (this->pending & ((uint32_t)1 << segment)) {
+      this->pending &= ~((uint32_t)1 << segment);
+      this->getRTGroup(segment, group);
+      return true;
     }
   }
-  return idxDevice;
+
+  uint8_t total = 4 + this->rtSegments;
+  if (this->cycle >= total)
+    this->cycle = 0;
+  for (uint8_t i = 0; i < total; i++) {
+    uint8_t index = this->cycle;
+    this->cycle = (this->cycle + 1 < total) ? this->cycle + 1 : 0;
+    if (index >= 4) {
+      this->getRTGroup(index - 4, group);
+      return true;
+    }
+    if (this->ps) {
+      for (uint8_t j = 0; j < 8; j++)
+        group.data[j] = pgm_read_byte(&this->ps[index].data[j]);
+      return true;
+    }
+  }
+
+  return false;
 }
+#endif
 
-/** @defgroup group02 Basic Functions*/
+
+#if QN800X_FEATURE_RDS_RX
+/** @defgroup group10 RDS RX*/
 
 /**
- * @ingroup group02 I2C
- * @brief Gets register information
- * @details QN800X commands. It provides a means to run commands that are not currently supported by the standard API.
- * @param registerNumber
- * @return uint8_t Value of the register
+ * @ingroup group10 RDS RX
+ * @brief Gets the latest RDS group received
+ * @details RDSD0 to RDSD7 and STATUS3 are read in a single burst. The device toggles RDS_RXTXUPD (STATUS3)
+ * @details when a new group is stored, so each group is returned only once.
+ * @details Check the block status (RDS0ERR to RDS3ERR) before using a block.
+ * @param group receives the group (block 1 in data[0] and data[1], block 2 in data[2] and data[3]...)
+ * @param status if not NULL, receives STATUS3 (synchronization and block errors)
+ * @return uint8_t QN800X_I2C_OK, QN800X_ERR_NOT_READY (no new group) or one of the QN800X_I2C_ERR_* codes
  */
-uint8_t QN800X::getRegister(uint8_t registerNumber) {
+uint8_t QN800X::rdsGetGroup(qn800x_rds_group *group, qn800x_status3 *status) {
+  uint8_t block[QN_STATUS3 - QN_RDSD0 + 1];
+  qn800x_status3 status3;
+  uint8_t error;
 
-  Wire.beginTransmission(QN800X_I2C_ADDRESS);
-  Wire.write(registerNumber);
-  Wire.endTransmission();
-  delayMicroseconds(QN800X_DELAY_COMMAND);
+  if ((error = this->readRegisters(QN_RDSD0, block, sizeof(block))) != QN800X_I2C_OK)
+    return error;
+  status3.raw = block[QN_STATUS3 - QN_RDSD0];
+  if (status)
+    *status = status3;
+  if (status3.arg.RDS_RXTXUPD == this->rdsRxUpdate)
+    return QN800X_ERR_NOT_READY;
 
-  Wire.requestFrom(QN800X_I2C_ADDRESS, 1);
-  return Wire.read();
+  this->rdsRxUpdate = status3.arg.RDS_RXTXUPD;
+  memcpy(group->data, block, sizeof(group->data));
+  return QN800X_I2C_OK;
 }
 
 /**
- * @ingroup group02 I2C
- * @brief Stores a velue to a given register
- * @details QN800X commands. It provides a means to run commands that are not currently supported by the standard API.
- * @param registerNumber
- * @param value
+ * @ingroup group10 RDS RX
+ * @brief Checks the alternative frequencies and keeps the strongest one
+ * @details Use it when the signal of the current channel degrades. Each alternative frequency is probed with a
+ * @details fast tune (QN_CH only when possible) followed by a RSSI reading. If no candidate is at least "margin" dB
+ * @details stronger than the current channel, the receiver goes back to the original channel.
+ * @details Probing stops before exceeding "timeout", so the total time is at most timeout plus one channel change.
+ * @details The PI of the new channel is not checked; use the RDS data to confirm it if needed.
+ * @param list alternative frequencies of the current station (see QN800XAfList)
+ * @param margin minimum RSSI improvement in dB
+ * @param timeout maximum time spent probing in ms
+ * @param probe maximum time waiting for the RX AGC on each candidate in ms
+ * @param switched if not NULL, receives true if the receiver moved to an alternative frequency
+ * @return uint8_t QN800X_I2C_OK (on the best channel, which may be the original one) or one of the QN800X_I2C_ERR_* codes
+ * @code
+ * uint8_t rssi, snr;
+ * uint16_t pi;
+ * bool switched;
+ * rx.getSignalQuality(&rssi, &snr);
+ * if (rssi < 20 && afs.getCount() > 0 && rx.switchToBestAF(afs, 6, 60, QN800X_AF_PROBE, &switched) == QN800X_I2C_OK && switched)
+ *   rx.rdsWaitPI(&pi, QN800X_PI_TIMEOUT);  // Confirm the station
+ * @endcode
  */
-void QN800X::setRegister(uint8_t registerNumber, uint8_t value) {
+uint8_t QN800X::switchToBestAF(const QN800XAfList &list, uint8_t margin, uint16_t timeout, uint16_t probe, bool *switched) {
+  uint32_t start = millis();
+  uint16_t original = this->currentChannel;
+  uint16_t best = original;
+  uint16_t bestRssi;
+  uint8_t  rssi, snr, error;
+
+  if (switched != NULL)
+    *switched = false;
+  if ((error = this->getSignalQuality(&rssi, &snr)) != QN800X_I2C_OK)
+    return error;
+  bestRssi = rssi + margin;
+
+  for (uint8_t i = 0; i < list.getCount() && millis() - start + probe <= timeout; i++) {
+    uint16_t channel = list.getChannel(i);
+    if (channel == original)
+      continue;
+    if ((error = this->setChannel(channel)) != QN800X_I2C_OK)
+      break;
+    if ((error = this->waitForRxReady(probe)) == QN800X_ERR_NOT_READY)
+      continue;
+    if (error != QN800X_I2C_OK || (error = this->getSignalQuality(&rssi, &snr)) != QN800X_I2C_OK)
+      break;
+    if (rssi >= bestRssi) {
+      bestRssi = rssi + 1;
+      best = channel;
+    }
+  }
 
-  Wire.beginTransmission(QN800X_I2C_ADDRESS);
-  Wire.write(registerNumber);
-  Wire.write(value);
-  Wire.endTransmission();
-  delayMicroseconds(QN800X_DELAY_COMMAND);
+  uint8_t result = this->setChannel(best);
+  if (error == QN800X_I2C_OK || error == QN800X_ERR_NOT_READY)
+    error = result;
+  if (error == QN800X_I2C_OK && switched != NULL)
+    *switched = (best != original);
+  return error;
 }
 
+/**
+ * @ingroup group10 RDS RX
+ * @brief Waits for the first valid Program Identification of the current channel
+ * @details Only STATUS3 is polled until the device is synchronized (RDSSYNC) and a new group arrives. The group
+ * @details and STATUS3 are then read in a single burst; the PI is accepted if block 1 has no error (RDS0ERR clear)
+ * @details and no other group arrived during the burst. No other block is decoded, so the PI is usually known
+ * @details after one or two groups (about 90ms each) instead of the many groups needed by the Program Service name.
+ * @param pi receives the PI code
+ * @param timeout maximum time in ms
+ * @return uint8_t QN800X_I2C_OK, QN800X_ERR_NOT_READY (no valid PI in time) or one of the QN800X_I2C_ERR_* codes
+ */
+uint8_t QN800X::rdsWaitPI(uint16_t *pi, uint16_t timeout) {
+  uint8_t block[QN_STATUS3 - QN_RDSD0 + 1];
+  qn800x_status3 status3;
+  uint8_t update, error;
+  uint32_t start = millis();
+
+  if ((error = this->readRegister(QN_STATUS3, &status3.raw)) != QN800X_I2C_OK)
+    return error;
+  update = status3.arg.RDS_RXTXUPD;
+
+  do {
+    if ((error = this->readRegister(QN_STATUS3, &status3.raw)) != QN800X_I2C_OK)
+      return error;
+    if (status3.arg.RDSSYNC && status3.arg.RDS_RXTXUPD != update) {
+      update = status3.arg.RDS_RXTXUPD;
+      if ((error = this->readRegisters(QN_RDSD0, block, sizeof(block))) != QN800X_I2C_OK)
+        return error;
+      status3.raw = block[QN_STATUS3 - QN_RDSD0];
+      if (status3.arg.RDS_RXTXUPD == update && !status3.arg.RDS0ERR) {
+        this->rdsRxUpdate = update;
+        *pi = ((uint16_t)block[0] << 8) | block[1];
+        return QN800X_I2C_OK;
+      }
+    }
+  } while (millis() - start < timeout);
+
+  return QN800X_ERR_NOT_READY;
+}
 
 /**
- * @ingroup group02 I2C
- * @brief Gets de device ID
- * @details Gets the Chip ID for product family (CID1) and Chip ID for minor revision (CID2)
- * @details See CIDR1 register (Address 0x05 - Datasheet page 36)   
- * @param value
+ * @ingroup group10 RDS RX
+ * @brief Adds the alternative frequencies carried by a 0A group
+ * @details Other groups are ignored. AF codes 1 to 204 are 87.6 to 107.9 MHz in 100kHz steps.
+ * @param group received group (see QN800X::rdsGetGroup). Blocks 1 to 3 must be valid
+ * @return true if a new alternative frequency was added
  */
-qn800x_cidr1 QN800X::getDeviceProductID() {
-    qn800x_cidr1 value;
-    value.raw = this->getRegister(QN_CIDR1);
-    return value;
-};
+bool QN800XAfList::decode(const qn800x_rds_group &group) {
+  RDS_BLOCK2 block2;
+  uint16_t pi = ((uint16_t)group.data[0] << 8) | group.data[1];
+  bool added = false;
+
+  block2.raw = ((uint16_t)group.data[2] << 8) | group.data[3];
+  if (block2.commonFields.groupType != 0 || block2.commonFields.versionCode != 0)
+    return false;
+
+  if (pi != this->pi) {
+    this->clear();
+    this->pi = pi;
+  }
+
+  for (uint8_t i = 4; i < 6; i++) {
+    uint8_t code = group.data[i];
+    if (this->skipNext) {
+      this->skipNext = false;
+    } else if (code == 250) {
+      this->skipNext = true;
+    } else if (code >= 1 && code <= 204 && this->count < QN800X_AF_MAX) {
+      uint16_t channel = (uint16_t)(875 + code - 760) * 2;
+      uint8_t n = 0;
+      while (n < this->count && this->channel[n] != channel)
+        n++;
+      if (n == this->count) {
+        this->channel[this->count++] = channel;
+        added = true;
+      }
+    }
+  }
+  return added;
+}
+
 
+/** @defgroup group11 Presets*/
 
 /**
- * @ingroup group02 I2C
- * @brief Gets de device ID
- * @details Gets the Chip ID for product family (CID3) and Chip ID for minor revision (CID4)
- * @param value
+ * @ingroup group11 Presets
+ * @brief Rebuilds the PI index (insertion sort; the store is small)
  */
-qn800x_cidr2 QN800X::getDeviceProductFamily() {
-    qn800x_cidr2 value;
-    value.raw = this->getRegister(QN_CIDR2);
-    return value;
+void QN800XPresetStore::indexPI() {
+  for (uint8_t i = 0; i < this->count; i++) {
+    uint8_t j = i;
+    while (j > 0 && this->preset[this->byPI[j - 1]].pi > this->preset[i].pi) {
+      this->byPI[j] = this->byPI[j - 1];
+      j--;
+    }
+    this->byPI[j] = i;
+  }
+}
+
+/**
+ * @ingroup group11 Presets
+ * @brief Adds a preset or replaces the preset of the same channel
+ * @param entry preset to be stored
+ * @return true on success; false if the store is full
+ */
+bool QN800XPresetStore::add(const qn800x_preset &entry) {
+  uint8_t low = 0, high = this->count;
+  while (low < high) {
+    uint8_t middle = (low + high) / 2;
+    if (this->preset[middle].channel < entry.channel)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  if (low == this->count || this->preset[low].channel != entry.channel) {
+    if (this->count == QN800X_PRESET_MAX)
+      return false;
+    memmove(&this->preset[low + 1], &this->preset[low], (this->count - low) * sizeof(qn800x_preset));
+    this->count++;
+  }
+  this->preset[low] = entry;
+  this->indexPI();
+  return true;
+}
+
+/**
+ * @ingroup group11 Presets
+ * @brief Removes the preset of a channel
+ * @param channel 10-bit channel index
+ * @return true if the preset was found and removed
+ */
+bool QN800XPresetStore::remove(uint16_t channel) {
+  int8_t index = this->findByChannel(channel);
+  if (index < 0)
+    return false;
+  this->count--;
+  memmove(&this->preset[index], &this->preset[index + 1], (this->count - index) * sizeof(qn800x_preset));
+  this->indexPI();
+  return true;
+}
+
+/**
+ * @ingroup group11 Presets
+ * @brief Finds the preset of a channel (binary search)
+ * @param channel 10-bit channel index
+ * @return int8_t preset index (see get) or -1 if not found
+ */
+int8_t QN800XPresetStore::findByChannel(uint16_t channel) const {
+  int8_t low = 0, high = (int8_t)this->count - 1;
+  while (low <= high) {
+    int8_t middle = (low + high) / 2;
+    if (this->preset[middle].channel == channel)
+      return middle;
+    if (this->preset[middle].channel < channel)
+      low = middle + 1;
+    else
+      high = middle - 1;
+  }
+  return -1;
+}
+
+/**
+ * @ingroup group11 Presets
+ * @brief Finds a station by PI (binary search)
+ * @details When the station is stored on more than one channel, the preset with the best quality is returned.
+ * @param pi Program Identification
+ * @return int8_t preset index (see get) or -1 if not found
+ */
+int8_t QN800XPresetStore::findByPI(uint16_t pi) const {
+  uint8_t low = 0, high = this->count;
+  int8_t best = -1;
+  while (low < high) {
+    uint8_t middle = (low + high) / 2;
+    if (this->preset[this->byPI[middle]].pi < pi)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  for (; low < this->count && this->preset[this->byPI[low]].pi == pi; low++)
+    if (best < 0 || this->preset[this->byPI[low]].quality > this->preset[best].quality)
+      best = this->byPI[low];
+  return best;
+}
+
+/**
+ * @ingroup group11 Presets
+ * @brief Saves the presets to a blob
+ * @details Layout: "QP", version (1), count, 13 bytes per preset (channel and PI little endian, PS, quality)
+ * @details and a CRC-16/CCITT (little endian). See QN800X_PRESET_BLOB_SIZE.
+ * @param blob destination buffer
+ * @param size buffer size in bytes
+ * @return uint16_t number of bytes used or 0 if the buffer is too small
+ */
+uint16_t QN800XPresetStore::save(uint8_t *blob, uint16_t size) const {
+  uint16_t length = QN800X_PRESET_BLOB_SIZE(this->count);
+  uint16_t n = 0, crc = 0xFFFF;
+
+  if (size < length)
+    return 0;
+
+  blob[n++] = 'Q';
+  blob[n++] = 'P';
+  blob[n++] = 1;
+  blob[n++] = this->count;
+  for (uint8_t i = 0; i < this->count; i++) {
+    const qn800x_preset &p = this->preset[i];
+    blob[n++] = (uint8_t)p.channel;
+    blob[n++] = (uint8_t)(p.channel >> 8);
+    blob[n++] = (uint8_t)p.pi;
+    blob[n++] = (uint8_t)(p.pi >> 8);
+    memcpy(&blob[n], p.ps, sizeof(p.ps));
+    n += sizeof(p.ps);
+    blob[n++] = p.quality;
+  }
+  for (uint16_t i = 0; i < n; i++)
+    crc = crc16Update(crc, blob[i]);
+  blob[n++] = (uint8_t)crc;
+  blob[n++] = (uint8_t)(crc >> 8);
+  return n;
+}
+
+/**
+ * @ingroup group11 Presets
+ * @brief Loads the presets from a blob created by save
+ * @details The current presets are kept if the blob is invalid (wrong header, size or CRC).
+ * @param blob source buffer
+ * @param size number of bytes available in blob
+ * @return true on success
+ */
+bool QN800XPresetStore::load(const uint8_t *blob, uint16_t size) {
+  uint16_t n = 4, crc = 0xFFFF;
+  uint16_t length;
+
+  if (size < QN800X_PRESET_BLOB_SIZE(0) || blob[0] != 'Q' || blob[1] != 'P' || blob[2] != 1 || blob[3] > QN800X_PRESET_MAX)
+    return false;
+  length = QN800X_PRESET_BLOB_SIZE(blob[3]);
+  if (size < length)
+    return false;
+  for (uint16_t i = 0; i < length - 2; i++)
+    crc = crc16Update(crc, blob[i]);
+  if (blob[length - 2] != (uint8_t)crc || blob[length - 1] != (uint8_t)(crc >> 8))
+    return false;
+
+  this->count = blob[3];
+  for (uint8_t i = 0; i < this->count; i++) {
+    qn800x_preset &p = this->preset[i];
+    p.channel = blob[n] | ((uint16_t)blob[n + 1] << 8);
+    p.pi = blob[n + 2] | ((uint16_t)blob[n + 3] << 8);
+    memcpy(p.ps, &blob[n + 4], sizeof(p.ps));
+    p.quality = blob[n + 12];
+    n += 13;
+  }
+  this->indexPI();
+  return true;
+}
+#endif
+
+
+#if QN800X_FEATURE_ROLE_SWITCH
+/** @defgroup group07 Role switch*/
+
+/**
+ * @ingroup group07 Role switch
+ * @brief Saves the current device configuration as the profile of a role
+ * @details Configure the device for the role (channel, gains, I2S, RDS...) and call this function.
+ * @details The configuration registers are read in a single burst.
+ * @param role QN800X_ROLE_RX or QN800X_ROLE_TX
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X_I2C_ERR_* codes
+ * @code
+ * // RX configuration
+ * ...
+ * dv.saveRoleProfile(QN800X_ROLE_RX);
+ * // TX configuration
+ * ...
+ * dv.saveRoleProfile(QN800X_ROLE_TX);
+ * ...
+ * dv.switchRole(QN800X_ROLE_RX);
+ * @endcode
+ */
+uint8_t QN800X::saveRoleProfile(uint8_t role) {
+  return this->saveSnapshot(&this->roleProfile[role & 1]);
+}
+
+/**
+ * @ingroup group07 Role switch
+ * @brief Sets the profile of a role from a snapshot
+ * @param role QN800X_ROLE_RX or QN800X_ROLE_TX
+ * @param profile register contents (see saveSnapshot)
+ */
+void QN800X::setRoleProfile(uint8_t role, const qn800x_snapshot *profile) {
+  memcpy(&this->roleProfile[role & 1], profile, sizeof(qn800x_snapshot));
+}
+
+/**
+ * @ingroup group07 Role switch
+ * @brief Switches the device between receiver and transmitter
+ * @details Only the registers that differ from the current configuration are written (see QN800XBatch),
+ * @details followed by the mode request (RXREQ or TXREQ in SYSTEM1), with no fixed delay. In RX mode, RXAGCSET (STATUS1)
+ * @details is polled until the receiver is ready. The device has no TX ready status, so in TX mode the function returns
+ * @details right after the mode request.
+ * @details The time spent is available in getRoleSwitchTime.
+ * @param role QN800X_ROLE_RX or QN800X_ROLE_TX
+ * @param timeout maximum time in ms waiting for the device to be ready
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X error codes
+ */
+uint8_t QN800X::switchRole(uint8_t role, uint16_t timeout) {
+  QN800XBatch batch(*this);
+  qn800x_snapshot *profile = &this->roleProfile[role & 1];
+  qn800x_system1 system1;
+  uint8_t error;
+#if QN800X_FEATURE_TELEMETRY
+  uint32_t start = micros();
+#endif
+
+  for (uint8_t reg = QN_SYSTEM2; reg < QN800X_SHADOW_SIZE; reg++) {
+    if (QN800X_RESTORE_MASK & ((uint32_t)1 << reg))
+      batch.setRegister(reg, (reg == QN_SYSTEM2) ? profile->raw[reg] & 0b00111111 : profile->raw[reg]);
+  }
+  system1.raw = profile->raw[QN_SYSTEM1];
+  system1.arg.STNBY = 0;
+  system1.arg.CHSC = 0;
+  system1.arg.RXREQ = (role == QN800X_ROLE_RX);
+  system1.arg.TXREQ = (role == QN800X_ROLE_TX);
+  batch.setRegister(QN_SYSTEM1, system1.raw);
+
+  if ((error = batch.commit()) != QN800X_I2C_OK)
+    return error;
+  this->currentChannel = ((uint16_t)(profile->raw[QN_CH_STEP] & 0b00000011) << 8) | profile->raw[QN_CH];
+  this->currentFrequency = this->currentChannel / 2 + 760;
+
+  // The QN8006/QN8007 has no TX ready status bit (STATUS1 and STATUS3 report RX and RDS states only), so a TX
+  // switch ends when the mode request is written. Only RX readiness (RXAGCSET) can be polled.
+  if (role == QN800X_ROLE_RX)
+    error = this->waitForRxReady(timeout);
+
+#if QN800X_FEATURE_TELEMETRY
+  this->roleSwitchTime = micros() - start;
+#endif
+  return error;
+}
+#endif
+
+
+#if QN800X_FEATURE_POWER
+/** @defgroup group06 Power*/
+
+/**
+ * @ingroup group06 Power
+ * @brief Sets the time out for the IDLE to standby state transition (TMOUT - SYSTEM2)
+ * @param timeout 0 = 1 min; 1 = 3 min; 2 = 5 min; 3 = never
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X_I2C_ERR_* codes
+ */
+uint8_t QN800X::setIdleTimeout(uint8_t timeout) {
+  QN800XBatch batch(*this);
+  batch.setField(QN_SYSTEM2, 0b00000011, timeout);
+  return batch.commit();
+}
+
+/**
+ * @ingroup group06 Power
+ * @brief Puts the device in standby
+ * @details The current mode request (RXREQ or TXREQ) is saved and restored by wakeUp.
+ * @details The register contents are kept by the device and in RAM, so the wake up needs a single write.
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X_I2C_ERR_* codes
+ */
+uint8_t QN800X::setStandby() {
+  qn800x_system1 system1;
+  uint8_t error;
+
+  if (this->powerStandby)
+    return QN800X_I2C_OK;
+  if ((error = this->getCachedRegister(QN_SYSTEM1, &system1.raw)) != QN800X_I2C_OK)
+    return error;
+
+  this->powerMode = system1.raw & 0b11000000;
+  system1.arg.RXREQ = system1.arg.TXREQ = 0;
+  system1.arg.STNBY = 1;
+  if ((error = this->writeRegister(QN_SYSTEM1, system1.raw)) != QN800X_I2C_OK)
+    return error;
+
+#if QN800X_FEATURE_TELEMETRY
+  uint32_t now = millis();
+  this->awakeTime += now - this->powerMark;
+  this->powerMark = now;
+#endif
+  this->powerStandby = true;
+  return QN800X_I2C_OK;
+}
+
+/**
+ * @ingroup group06 Power
+ * @brief Leaves the standby mode
+ * @details Writes only SYSTEM1 with the saved mode request. In RX mode, if the receiver is not ready in time,
+ * @details the whole configuration kept in RAM is written back (restoreRegisters) and the device is checked again.
+ * @details The time spent is available in getWakeLatency.
+ * @param waitReady if true, waits for the receiver to be ready (RX mode only)
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X error codes
+ */
+uint8_t QN800X::wakeUp(bool waitReady) {
+  qn800x_system1 system1;
+  uint8_t error;
+#if QN800X_FEATURE_TELEMETRY
+  uint32_t start = micros();
+#endif
+
+  if (!this->powerStandby)
+    return QN800X_I2C_OK;
+  if ((error = this->getCachedRegister(QN_SYSTEM1, &system1.raw)) != QN800X_I2C_OK)
+    return error;
+
+  system1.arg.STNBY = 0;
+  system1.raw |= this->powerMode;
+  if ((error = this->writeRegister(QN_SYSTEM1, system1.raw)) != QN800X_I2C_OK)
+    return error;
+
+#if QN800X_FEATURE_TELEMETRY
+  uint32_t now = millis();
+  this->standbyTime += now - this->powerMark;
+  this->powerMark = now;
+#endif
+  this->powerStandby = false;
+
+#if QN800X_FEATURE_RX
+  if (waitReady && system1.arg.RXREQ) {
+    if (this->waitForRxReady() == QN800X_ERR_NOT_READY) {
+      if ((error = this->restoreRegisters()) != QN800X_I2C_OK)
+        return error;
+      error = this->waitForRxReady();
+    }
+  }
+#else
+  (void)waitReady;
+#endif
+
+#if QN800X_FEATURE_TELEMETRY
+  this->wakeLatency = micros() - start;
+#endif
+  return error;
+}
+
+/**
+ * @ingroup group06 Power
+ * @brief Sets the measurement windows used by powerTask
+ * @details The device stays ready during "window" ms at every "period" ms and in standby the rest of the time.
+ * @param period time between the beginning of two windows in ms (0 = disable the schedule)
+ * @param window window length in ms
+ */
+void QN800X::setPowerSchedule(uint32_t period, uint16_t window) {
+  this->powerPeriod = period;
+  this->powerWindow = window;
+  this->powerCycleStart = millis();
+#if QN800X_FEATURE_TELEMETRY
+  this->powerMark = this->powerCycleStart;
+  this->awakeTime = this->standbyTime = 0;
+#endif
+}
+
+/**
+ * @ingroup group06 Power
+ * @brief Runs the power schedule. Call it in the loop function
+ * @details QN800X_POWER_ERROR is returned when the wake up or the standby fails, and during the whole window when the
+ * @details device did not become ready. A failed I2C access is retried on the next call. See getPowerError.
+ * @return uint8_t QN800X_POWER_STANDBY, QN800X_POWER_WINDOW_OPEN, QN800X_POWER_WINDOW_ACTIVE, QN800X_POWER_WINDOW_CLOSED or QN800X_POWER_ERROR
+ * @code
+ * void setup() {
+ *   ...
+ *   rx.setPowerSchedule(60000, 500); // 500ms measurement every minute
+ * }
+ *
+ * void loop() {
+ *   if (rx.powerTask() == QN800X_POWER_WINDOW_OPEN) {
+ *     // Take the measurements here
+ *   }
+ * }
+ * @endcode
+ */
+uint8_t QN800X::powerTask() {
+  uint32_t now = millis();
+
+  if (this->powerPeriod == 0)
+    return (this->powerStandby) ? QN800X_POWER_STANDBY : QN800X_POWER_WINDOW_ACTIVE;
+
+  if (!this->powerStandby) {
+    if (now - this->powerCycleStart < this->powerWindow)
+      return (this->powerError == QN800X_I2C_OK) ? QN800X_POWER_WINDOW_ACTIVE : QN800X_POWER_ERROR;
+    if ((this->powerError = this->setStandby()) != QN800X_I2C_OK)
+      return QN800X_POWER_ERROR;
+    return QN800X_POWER_WINDOW_CLOSED;
+  }
+
+  if (now - this->powerCycleStart < this->powerPeriod)
+    return QN800X_POWER_STANDBY;
+
+  this->powerError = this->wakeUp(true);
+  if (this->powerStandby)
+    return QN800X_POWER_ERROR;    // SYSTEM1 was not written; try again on the next call
+
+  // Keep the schedule; skip windows that were missed
+  this->powerCycleStart += ((now - this->powerCycleStart) / this->powerPeriod) * this->powerPeriod;
+  return (this->powerError == QN800X_I2C_OK) ? QN800X_POWER_WINDOW_OPEN : QN800X_POWER_ERROR;
+}
+
+#if QN800X_FEATURE_TELEMETRY
+/**
+ * @ingroup group06 Power
+ * @brief Returns the measured fraction of time out of standby since setPowerSchedule
+ * @return uint16_t duty cycle in per mille (0 to 1000)
+ */
+uint16_t QN800X::getDutyCycle() {
+  uint32_t now = millis();
+  uint32_t awake = this->awakeTime + ((this->powerStandby) ? 0 : now - this->powerMark);
+  uint32_t total = awake + this->standbyTime + ((this->powerStandby) ? now - this->powerMark : 0);
+  while (awake > 4000000) {   // avoids overflow in awake * 1000
+    awake >>= 1;
+    total >>= 1;
+  }
+  return (total) ? (uint16_t)(awake * 1000 / total) : 1000;
+}
+
+/**
+ * @ingroup group06 Power
+ * @brief Estimates the duty cycle of the power schedule
+ * @details Considers the window length plus the latest wake up latency.
+ * @return uint16_t duty cycle in per mille (0 to 1000)
+ */
+uint16_t QN800X::getEstimatedDutyCycle() {
+  if (this->powerPeriod == 0)
+    return 1000;
+  uint32_t active = this->powerWindow + this->wakeLatency / 1000;
+  return (active >= this->powerPeriod) ? 1000 : (uint16_t)(active * 1000 / this->powerPeriod);
 }
+#endif
+#endif
 
 
 /** @defgroup group99 Helper and Tools functions*/
@@ -185,6 +2082,7 @@ void QN800X::convertToChar(uint16_t value, char *strValue, uint8_t len, uint8_t
     }
 }
 
+#if QN800X_FEATURE_FREQ_STRING
 /**
  * @ingroup group99 Covert numbers to char array
  * @brief Convert the current frequency to a formated string (char *) frequency
@@ -198,3 +2096,194 @@ char* QN800X::formatCurrentFrequency(char decimalSeparator)
    this->convertToChar(this->currentFrequency, this->strCurrentFrequency, 4, 3, decimalSeparator, true);
    return this->strCurrentFrequency;
 }
+#endif
+
+
+#if QN800X_FEATURE_CMD_QUEUE
+/** @defgroup group09 Command queue*/
+
+/**
+ * @ingroup group09 Command queue
+ * @brief Waits for the command to be executed
+ * @param timeout maximum time in ticks
+ * @return true if the command was executed (see error and value)
+ */
+bool QN800XFuture::wait(TickType_t timeout) {
+  while (!this->isDone()) {
+    if (ulTaskNotifyTake(pdTRUE, timeout) == 0)
+      break;
+  }
+  return this->isDone();
+}
+
+/**
+ * @ingroup group09 Command queue
+ * @brief Creates the synchronization objects. Call it before creating the tasks
+ * @return true if successful
+ */
+bool QN800XCommandQueue::begin() {
+  this->lock = xSemaphoreCreateMutex();
+  this->signal = xSemaphoreCreateCounting(QN800X_CMD_QUEUE_SIZE, 0);
+  return this->lock != NULL && this->signal != NULL;
+}
+
+/**
+ * @ingroup group09 Command queue
+ * @brief Submits a command. Can be called from any task
+ * @param type QN800X_CMD_READ, QN800X_CMD_WRITE, QN800X_CMD_UPDATE or QN800X_CMD_TUNE
+ * @param reg register address (not used by QN800X_CMD_TUNE)
+ * @param mask bits changed by QN800X_CMD_UPDATE
+ * @param value register value (QN800X_CMD_WRITE, QN800X_CMD_UPDATE) or channel (QN800X_CMD_TUNE)
+ * @param priority higher values run first; commands with the same priority run in submission order
+ * @param future receives the result (optional). Must stay valid until the command is executed.
+ * @param callback called by the owner task when the command is executed (optional)
+ * @param context passed to the callback
+ * @return false if the queue is full (the future, if any, is completed with QN800X_ERR_QUEUE_FULL)
+ */
+bool QN800XCommandQueue::submit(uint8_t type, uint8_t reg, uint8_t mask, uint16_t value, uint8_t priority,
+                                QN800XFuture *future, qn800x_cmd_callback callback, void *context) {
+  bool accepted = false;
+
+  if (type == QN800X_CMD_TUNE)
+    reg = QN_CH;
+  if (type == QN800X_CMD_WRITE)
+    mask = 0xFF;
+  if (future) {
+    future->setDone(false);
+    future->waiter = xTaskGetCurrentTaskHandle();
+  }
+
+  xSemaphoreTake(this->lock, portMAX_DELAY);
+
+  // The latest pending command on the same register
+  qn800x_cmd *last = NULL;
+  for (uint8_t i = 0; i < this->count; i++) {
+    if (this->queue[i].reg == reg && (last == NULL || (uint16_t)(this->queue[i].sequence - last->sequence) < 0x8000))
+      last = &this->queue[i];
+  }
+
+  bool compatible = last != NULL &&
+                    ((type == QN800X_CMD_TUNE) ? last->type == QN800X_CMD_TUNE
+                                               : (type != QN800X_CMD_READ && (last->type == QN800X_CMD_WRITE || last->type == QN800X_CMD_UPDATE)));
+  bool targets = (future || callback) && (last != NULL && (last->future || last->callback));
+
+  if (compatible && !targets) {
+    if (type == QN800X_CMD_TUNE) {
+      last->value = value;
+    } else {
+      last->value = (last->value & ~mask) | (value & mask);
+      last->mask |= mask;
+      if (last->mask == 0xFF)
+        last->type = QN800X_CMD_WRITE;
+    }
+    if (priority > last->priority)
+      last->priority = priority;
+    if (future || callback) {
+      last->future = future;
+      last->callback = callback;
+      last->context = context;
+    }
+    this->merged++;
+    accepted = true;
+  } else if (this->count < QN800X_CMD_QUEUE_SIZE) {
+    qn800x_cmd &command = this->queue[this->count++];
+    command.type = type;
+    command.priority = priority;
+    command.reg = reg;
+    command.mask = mask;
+    command.value = value;
+    command.sequence = this->sequence++;
+    command.future = future;
+    command.callback = callback;
+    command.context = context;
+    accepted = true;
+    xSemaphoreGive(this->signal);
+  }
+
+  xSemaphoreGive(this->lock);
+
+  if (!accepted && future) {
+    future->error = QN800X_ERR_QUEUE_FULL;
+    future->setDone(true);
+  }
+  return accepted;
+}
+
+/**
+ * @ingroup group09 Command queue
+ * @brief Runs a command on the device (owner task only)
+ */
+uint8_t QN800XCommandQueue::execute(qn800x_cmd &command, uint8_t *value) {
+  uint8_t error;
+  *value = 0;
+  switch (command.type) {
+    case QN800X_CMD_READ:
+      return this->device->readRegister(command.reg, value);
+    case QN800X_CMD_WRITE:
+      *value = (uint8_t)command.value;
+      return this->device->writeRegister(command.reg, (uint8_t)command.value);
+    case QN800X_CMD_UPDATE: {
+      QN800XBatch batch(*this->device);
+      if ((error = batch.setField(command.reg, command.mask, (uint8_t)command.value)) != QN800X_I2C_OK)
+        return error;
+      *value = batch.get(command.reg);
+      return batch.commit();
+    }
+    case QN800X_CMD_TUNE:
+      return this->device->setChannel(command.value);
+  }
+  return QN800X_ERR_INVALID_REGISTER;
+}
+
+/**
+ * @ingroup group09 Command queue
+ * @brief Runs the pending commands. Call it in a loop of the owner task
+ * @details Waits for a command, then runs all pending commands, highest priority first.
+ * @param wait maximum time in ticks waiting for the first command
+ * @return uint8_t number of commands executed
+ */
+uint8_t QN800XCommandQueue::process(TickType_t wait) {
+  uint8_t executed = 0;
+
+  if (xSemaphoreTake(this->signal, wait) != pdTRUE)
+    return 0;
+
+  for (;;) {
+    qn800x_cmd command;
+
+    xSemaphoreTake(this->lock, portMAX_DELAY);
+    if (this->count == 0) {
+      xSemaphoreGive(this->lock);
+      break;
+    }
+    uint8_t next = 0;
+    for (uint8_t i = 1; i < this->count; i++) {
+      if (this->queue[i].priority > this->queue[next].priority ||
+          (this->queue[i].priority == this->queue[next].priority && (uint16_t)(this->queue[i].sequence - this->queue[next].sequence) >= 0x8000))
+        next = i;
+    }
+    command = this->queue[next];
+    this->queue[next] = this->queue[--this->count];
+    xSemaphoreGive(this->lock);
+
+    if (executed > 0)
+      xSemaphoreTake(this->signal, 0);
+
+    uint8_t value;
+    uint8_t error = this->execute(command, &value);
+    executed++;
+
+    if (command.callback)
+      command.callback(error, value, command.context);
+    if (command.future) {
+      // The future may be released by its task as soon as done is set
+      TaskHandle_t waiter = command.future->waiter;
+      command.future->error = error;
+      command.future->value = value;
+      command.future->setDone(true);
+      xTaskNotifyGive(waiter);
+    }
+  }
+  return executed;
+}
+#endif
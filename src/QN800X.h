@@ -17,11 +17,110 @@
 
 #include <Arduino.h>
 #include <Wire.h>
+#include "QN800XConfig.h"
+
+#if QN800X_FEATURE_CMD_QUEUE
+#if defined(ARDUINO_ARCH_ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#else
+#include <FreeRTOS.h>
+#include <semphr.h>
+#endif
+#endif
 
 #define QN800X_I2C_ADDRESS 0x2B   // See Datasheet pag. 25 (5.1 2-Wire Serial Control Interface).
+#define QN800X_I2C_DADD_ADDRESS 0x2A  // Address used after power up when SEB=1 (DADD default in DEV_ADD)
 #define QN800X_RESET_DELAY 1000   // Delay after reset in us
 #define QN800X_DELAY_COMMAND 2500 // Delay after command
 
+#define QN800X_I2C_RETRIES     2      // Extra attempts after a failed I2C transaction
+#define QN800X_I2C_BACKOFF     100    // Delay (us) before the first retry. It doubles on every new attempt
+#define QN800X_I2C_BACKOFF_MAX 16000  // Upper limit (us) for the retry delay
+#define QN800X_I2C_TIMEOUT     25000  // Wire timeout (us) per transaction, when supported by the platform
+#define QN800X_I2C_PIN_TIME      5    // Upper bound (us) of one pinMode, digitalWrite or digitalRead call (AVR 16MHz: about 4us)
+#define QN800X_I2C_RESTART_TIME  200  // Upper bound (us) of Wire.end, Wire.begin and the retry policy setup in the bus recovery
+// Upper bound (us) of recoverI2CBus: 9 SCL pulses and the STOP condition (10us of delays and 4 pin calls each),
+// 2 pinMode calls before the pulses and the Wire restart
+#define QN800X_I2C_RECOVERY_TIME ((9 + 1) * (10 + 4 * QN800X_I2C_PIN_TIME) + 2 * QN800X_I2C_PIN_TIME + QN800X_I2C_RESTART_TIME)
+#define QN800X_I2C_PROBE_TIMEOUT 1000 // Wire timeout (us) of each address probed by discoverDevices
+#define QN800X_I2C_PROBE_DELAY   0    // Delay (us) after each address probed by discoverDevices
+
+#define QN800X_SHADOW_SIZE     0x1A   // Registers 00h (SYSTEM1) to 19h (CCA) are kept in RAM
+#define QN800X_BATCH_MAX_GAP   2      // Unchanged registers a batch may rewrite to join two bursts
+
+#if defined(I2C_BUFFER_LENGTH)
+#define QN800X_I2C_BUFFER I2C_BUFFER_LENGTH   // Wire buffer size (ESP32)
+#elif defined(BUFFER_LENGTH)
+#define QN800X_I2C_BUFFER BUFFER_LENGTH       // Wire buffer size (AVR)
+#else
+#define QN800X_I2C_BUFFER 32
+#endif
+#define QN800X_SETTLING_TIMEOUT 100   // Maximum time (ms) waiting for the RX AGC to settle
+
+/**
+ * @brief Power schedule states (see powerTask)
+ */
+
+#define QN800X_POWER_STANDBY       0  //!< The device is in standby waiting for the next measurement window.
+#define QN800X_POWER_WINDOW_OPEN   1  //!< The device has just left standby and is ready.
+#define QN800X_POWER_WINDOW_ACTIVE 2  //!< Inside a measurement window.
+#define QN800X_POWER_WINDOW_CLOSED 3  //!< The window has just ended and the device entered standby.
+#define QN800X_POWER_ERROR         4  //!< The latest wake up or standby failed; do not take measurements (see getPowerError).
+
+/**
+ * @brief Parts told apart by the product ID (CID3 in CIDR2). See QN800X::getDevicePart
+ */
+
+#define QN800X_PART_UNKNOWN 0  //!< Reserved CID3 value or the ID could not be read.
+#define QN800X_PART_QN8006  1  //!< Transceiver QN8006 (CID3 = 0011).
+#define QN800X_PART_QN8006L 2  //!< Transceiver QN8006L (CID3 = 0111).
+#define QN800X_PART_QN8007  3  //!< Transmitter QN8007 (CID3 = 0001).
+#define QN800X_PART_QN8007L 4  //!< Transmitter QN8007L (CID3 = 0101).
+
+/**
+ * @brief Device roles (see switchRole)
+ */
+
+#define QN800X_ROLE_RX 0  //!< Receiver
+#define QN800X_ROLE_TX 1  //!< Transmitter
+
+#define QN800X_SWEEP_SETTLING 10  // Maximum time (ms) waiting for the RX AGC on each channel of a sweep
+#define QN800X_PI_TIMEOUT     300 // Maximum time (ms) waiting for the first valid PI on each station found by scanStations
+
+/**
+ * @brief Command types (see QN800XCommandQueue)
+ */
+
+#define QN800X_CMD_READ       0  //!< Read a register
+#define QN800X_CMD_WRITE      1  //!< Write a register
+#define QN800X_CMD_UPDATE     2  //!< Change some bits of a register (atomic read-modify-write)
+#define QN800X_CMD_TUNE       3  //!< Set the 10-bit channel index (setChannel)
+
+#define QN800X_CMD_QUEUE_SIZE 8  // Maximum number of pending commands
+
+#define QN800X_PRESET_MAX 16      // Capacity of QN800XPresetStore
+#define QN800X_AF_MAX     12      // Alternative frequencies kept by QN800XAfList
+#define QN800X_AF_PROBE   8       // Maximum time (ms) waiting for the RX AGC on each alternative frequency probe
+
+/**
+ * @brief I2C result codes
+ * @details Codes 0 to 5 are the same values returned by Wire.endTransmission().
+ */
+
+#define QN800X_I2C_OK                0  //!< Success.
+#define QN800X_I2C_ERR_DATA_TOO_LONG 1  //!< Data too long to fit in the Wire transmit buffer.
+#define QN800X_I2C_ERR_NACK_ADDRESS  2  //!< NACK received on transmit of the device address.
+#define QN800X_I2C_ERR_NACK_DATA     3  //!< NACK received on transmit of data.
+#define QN800X_I2C_ERR_OTHER         4  //!< Other Wire error (bus error, arbitration lost).
+#define QN800X_I2C_ERR_TIMEOUT       5  //!< Wire timeout.
+#define QN800X_I2C_ERR_SHORT_READ    6  //!< The device returned fewer bytes than requested.
+#define QN800X_I2C_ERR_BUS_STUCK     7  //!< SDA is still held low after the bus recovery procedure.
+#define QN800X_ERR_INVALID_REGISTER  8  //!< The register cannot be used by the requested operation.
+#define QN800X_ERR_NOT_READY         9  //!< The device did not reach the expected state in time.
+#define QN800X_ERR_QUEUE_FULL       10  //!< The command queue has no room for a new command.
+#define QN800X_ERR_INVALID_ARGUMENT 11  //!< A parameter is out of range (for example, a channel above 1023).
+
 /**
  * @brief QN800X Register addresses
  *
@@ -63,6 +162,103 @@
 #define QN_PAC_CAL    0x59  //!< PA tuning cap calibration.    
 #define QN_PAG_CAL    0x5A  //!< PA gain calibration.
 
+/**
+ * @brief Register attributes (see QN800X_REG_MAP)
+ */
+
+#define QN800X_REG_VOLATILE 0x01  //!< Changed by the device (status, received data). Never kept in RAM.
+#define QN800X_REG_SETTLING 0x02  //!< Starts an internal process when written. Needs QN800X_DELAY_COMMAND before the next command.
+
+/**
+ * @brief Register map entry
+ * @details The reset value is the default listed in the QN8006 datasheet register tables (extras/Docs). Read only
+ * @details registers, whose content is set by the device, use 0x00.
+ */
+typedef struct {
+  uint8_t address;     //!< Register address
+  char    name[9];     //!< Register name (see dumpRegisters)
+  uint8_t resetValue;  //!< Default value after power up or SWRST
+  uint8_t writeMask;   //!< Bits that can be written (0 = read only)
+  uint8_t commandMask; //!< Self-clearing command bits (CHSC, SWRST, RECAL). Never kept in RAM, so they are not written again
+  uint8_t flags;       //!< QN800X_REG_VOLATILE and QN800X_REG_SETTLING
+} qn800x_reg_info;
+
+/**
+ * @brief QN800X register map
+ * @details Register cache, burst grouping, snapshot/restore and register dump are derived from this table.
+ * @details It is stored in flash (PROGMEM). At run time, use QN800X::getRegisterInfo to read an entry.
+ */
+static constexpr qn800x_reg_info QN800X_REG_MAP[] PROGMEM = {
+  {QN_SYSTEM1,    "SYSTEM1",  0x01, 0xFF, 0x20, 0},
+  {QN_SYSTEM2,    "SYSTEM2",  0x09, 0xFF, 0xC0, QN800X_REG_SETTLING},
+  {QN_DEV_ADD,    "DEV_ADD",  0x2A, 0xFF, 0x00, 0},
+  {QN_ANACTL1,    "ANACTL1",  0x2B, 0xFF, 0x00, QN800X_REG_SETTLING},
+  {QN_REG_VGA,    "REG_VGA",  0x60, 0xFF, 0x00, QN800X_REG_SETTLING},
+  {QN_CIDR1,      "CIDR1",    0x00, 0x00, 0x00, 0},
+  {QN_CIDR2,      "CIDR2",    0x00, 0x00, 0x00, 0},
+  {QN_I2S,        "I2S",      0x71, 0xFF, 0x00, 0},
+  {QN_CH,         "CH",       0xA0, 0xFF, 0x00, 0},
+  {QN_CH_START,   "CH_START", 0x00, 0xFF, 0x00, 0},
+  {QN_CH_STOP,    "CH_STOP",  0x80, 0xFF, 0x00, 0},
+  {QN_CH_STEP,    "CH_STEP",  0x60, 0xFF, 0x00, 0},
+  {QN_PAC_TARGET, "PAC_TRGT", 0xFF, 0xFF, 0x00, QN800X_REG_SETTLING},
+  {QN_TXAGC_GAIN, "TXAGC",    0x01, 0xFF, 0x00, 0},
+  {QN_TX_FDEV,    "TX_FDEV",  0x6C, 0xFF, 0x00, 0},
+  {QN_GAIN_TXPLT, "TXPLT",    0x24, 0xFF, 0x00, 0},
+  {QN_RDSD0,      "RDSD0",    0x00, 0xFF, 0x00, QN800X_REG_VOLATILE},
+  {QN_RDSD1,      "RDSD1",    0x00, 0xFF, 0x00, QN800X_REG_VOLATILE},
+  {QN_RDSD2,      "RDSD2",    0x00, 0xFF, 0x00, QN800X_REG_VOLATILE},
+  {QN_RDSD3,      "RDSD3",    0x00, 0xFF, 0x00, QN800X_REG_VOLATILE},
+  {QN_RDSD4,      "RDSD4",    0x00, 0xFF, 0x00, QN800X_REG_VOLATILE},
+  {QN_RDSD5,      "RDSD5",    0x00, 0xFF, 0x00, QN800X_REG_VOLATILE},
+  {QN_RDSD6,      "RDSD6",    0x00, 0xFF, 0x00, QN800X_REG_VOLATILE},
+  {QN_RDSD7,      "RDSD7",    0x00, 0xFF, 0x00, QN800X_REG_VOLATILE},
+  {QN_RDSFDEV,    "RDSFDEV",  0x86, 0xFF, 0x00, 0},
+  {QN_CCA,        "CCA",      0x49, 0xFF, 0x00, 0},
+  {QN_STATUS1,    "STATUS1",  0x00, 0x00, 0x00, QN800X_REG_VOLATILE},
+  {QN_STATUS3,    "STATUS3",  0x00, 0x00, 0x00, QN800X_REG_VOLATILE},
+  {QN_RSSISIG,    "RSSISIG",  0x00, 0x00, 0x00, QN800X_REG_VOLATILE},
+  {QN_RSSIMP,     "RSSIMP",   0x00, 0x00, 0x00, QN800X_REG_VOLATILE},
+  {QN_SNR,        "SNR",      0x00, 0x00, 0x00, QN800X_REG_VOLATILE},
+  {QN_REG_XLT3,   "REG_XLT3", 0x04, 0x10, 0x00, QN800X_REG_SETTLING},
+  {QN_REG_DAC,    "REG_DAC",  0x01, 0x03, 0x00, 0},
+  {QN_PAC_CAL,    "PAC_CAL",  0x00, 0xFF, 0x00, QN800X_REG_VOLATILE | QN800X_REG_SETTLING},
+  {QN_PAG_CAL,    "PAG_CAL",  0x0F, 0x7F, 0x00, QN800X_REG_VOLATILE | QN800X_REG_SETTLING}
+};
+
+#define QN800X_REG_COUNT (sizeof(QN800X_REG_MAP) / sizeof(qn800x_reg_info))
+
+/**
+ * @brief Builds a bit mask (bit n = register n, registers 00h to 1Fh) from the register map at compile time
+ * @details Use it only to initialize constexpr values; the map is in flash and cannot be read directly at run time on AVR.
+ * @param flagMask attribute bits to check (0 = check only the write mask)
+ * @param flagValue expected value of the attribute bits
+ * @param writable if true, only registers with some writable bit are selected
+ * @param index internal (recursion)
+ */
+constexpr uint32_t qn800xRegMask(uint8_t flagMask, uint8_t flagValue, bool writable, uint8_t index = 0) {
+  return (index >= QN800X_REG_COUNT) ? 0 :
+         (((QN800X_REG_MAP[index].address < 32 && (QN800X_REG_MAP[index].flags & flagMask) == flagValue && (!writable || QN800X_REG_MAP[index].writeMask != 0))
+              ? (uint32_t)1 << QN800X_REG_MAP[index].address : 0) |
+          qn800xRegMask(flagMask, flagValue, writable, index + 1));
+}
+
+/**
+ * @brief Builds a bit mask (bit n = register n, registers 00h to 1Fh) of the registers with self-clearing command bits
+ * @param index internal (recursion)
+ */
+constexpr uint32_t qn800xCommandRegMask(uint8_t index = 0) {
+  return (index >= QN800X_REG_COUNT) ? 0 :
+         (((QN800X_REG_MAP[index].address < 32 && QN800X_REG_MAP[index].commandMask != 0) ? (uint32_t)1 << QN800X_REG_MAP[index].address : 0) |
+          qn800xCommandRegMask(index + 1));
+}
+
+constexpr uint32_t QN800X_CACHE_MASK = qn800xRegMask(QN800X_REG_VOLATILE, 0, false) & ((1UL << QN800X_SHADOW_SIZE) - 1);   //!< Registers kept in RAM
+constexpr uint32_t QN800X_WRITABLE_MASK = qn800xRegMask(0, 0, true);                                                         //!< Registers (00h to 1Fh) with writable bits
+constexpr uint32_t QN800X_RESTORE_MASK = qn800xRegMask(QN800X_REG_VOLATILE, 0, true) & ((1UL << QN800X_SHADOW_SIZE) - 1);  //!< Cached registers that can be written back
+constexpr uint32_t QN800X_SETTLING_MASK = qn800xRegMask(QN800X_REG_SETTLING, QN800X_REG_SETTLING, false);                    //!< Registers (00h to 1Fh) that need settling time
+constexpr uint32_t QN800X_COMMAND_MASK = qn800xCommandRegMask();                                                             //!< Registers (00h to 1Fh) with self-clearing command bits
+
 
 /** @defgroup group00 Union, Struct and Defined Data Types
  * @section group01 Data Types
@@ -191,9 +387,9 @@ typedef union {
  */
 typedef union {
   struct {
-    uint8_t   CID2:2;
-    uint8_t   CID1:4;
-    uint8_t   Rsvd:2;
+    uint8_t   CID2:2;   //!< Chip ID for minor revision
+    uint8_t   CID1:3;   //!< Chip ID for product family (000 = FM)
+    uint8_t   Rsvd:3;
   } arg;
   uint8_t raw;
 } qn800x_cidr1;
@@ -204,8 +400,8 @@ typedef union {
  */
 typedef union {
   struct {
-    uint8_t   CID4:2;
-    uint8_t   CID3:4;
+    uint8_t   CID4:4;   //!< Chip ID for major revision
+    uint8_t   CID3:4;   //!< Chip ID for product ID (see QN800X_PART_*)
   } arg;
   uint8_t raw;
 } qn800x_cidr2;
@@ -708,6 +904,134 @@ typedef union {
   uint8_t  raw[2];  
 } WORD16;
 
+/**
+ * @ingroup group00 RDS
+ * @brief RDS group as written to RDSD0 to RDSD7
+ * @details Blocks 1 to 4, most significant byte first.
+ */
+typedef struct {
+  uint8_t data[8];
+} qn800x_rds_group;
+
+#if QN800X_FEATURE_RDS_TX
+/**
+ * @ingroup group05 RDS TX
+ * @brief Builds the second block of a RDS group
+ * @param groupType group type code (0 to 15)
+ * @param versionCode 0=A; 1=B
+ * @param tp Traffic Program code
+ * @param pty Program Type code
+ * @param low the 5 least significant bits (group specific)
+ */
+constexpr uint16_t qn800xRdsBlock2(uint8_t groupType, uint8_t versionCode, bool tp, uint8_t pty, uint8_t low) {
+  return (uint16_t)(((groupType & 0x0F) << 12) | ((versionCode & 1) << 11) | ((tp ? 1 : 0) << 10) | ((pty & 0x1F) << 5) | (low & 0x1F));
+}
+
+/**
+ * @ingroup group05 RDS TX
+ * @brief Builds a RDS group from its four blocks
+ */
+constexpr qn800x_rds_group qn800xRdsGroup(uint16_t block1, uint16_t block2, uint16_t block3, uint16_t block4) {
+  return qn800x_rds_group{{(uint8_t)(block1 >> 8), (uint8_t)block1, (uint8_t)(block2 >> 8), (uint8_t)block2,
+                           (uint8_t)(block3 >> 8), (uint8_t)block3, (uint8_t)(block4 >> 8), (uint8_t)block4}};
+}
+
+/**
+ * @ingroup group05 RDS TX
+ * @brief Builds one of the four 0A groups (Program Service name and flags)
+ * @details Block 3 carries the "no Alternative Frequency" code (0xE0CD).
+ * @param pi Program Identification
+ * @param pty Program Type code
+ * @param tp Traffic Program code
+ * @param ta Traffic Announcement
+ * @param ms Music (1) or Speech (0)
+ * @param di Decoder Identification bits (d3 is sent on segment 0)
+ * @param segment segment address (0 to 3)
+ * @param ps Program Service name (8 characters)
+ */
+constexpr qn800x_rds_group qn800xRdsGroup0A(uint16_t pi, uint8_t pty, bool tp, bool ta, bool ms, uint8_t di, uint8_t segment, const char *ps) {
+  return qn800xRdsGroup(pi,
+                        qn800xRdsBlock2(0, 0, tp, pty, ((ta ? 1 : 0) << 4) | ((ms ? 1 : 0) << 3) | (((di >> (3 - (segment & 3))) & 1) << 2) | (segment & 3)),
+                        0xE0CD,
+                        (uint16_t)(((uint8_t)ps[(segment & 3) * 2] << 8) | (uint8_t)ps[(segment & 3) * 2 + 1]));
+}
+
+/**
+ * @ingroup group05 RDS TX
+ * @brief Builds the four 0A groups of a station at compile time
+ * @details Use it to initialize a constant array of four qn800x_rds_group. With PROGMEM the groups are kept in flash.
+ * @code
+ * static constexpr qn800x_rds_group stationPS[4] PROGMEM = QN800X_RDS_PS_GROUPS(0x1234, 10, false, false, true, 0, "PU2CLR  ");
+ * @endcode
+ */
+#define QN800X_RDS_PS_GROUPS(pi, pty, tp, ta, ms, di, ps)   \
+  { qn800xRdsGroup0A(pi, pty, tp, ta, ms, di, 0, ps),       \
+    qn800xRdsGroup0A(pi, pty, tp, ta, ms, di, 1, ps),       \
+    qn800xRdsGroup0A(pi, pty, tp, ta, ms, di, 2, ps),       \
+    qn800xRdsGroup0A(pi, pty, tp, ta, ms, di, 3, ps) }
+#endif
+
+/**
+ * @ingroup group00
+ * @brief Copy of the configuration registers (00h to 19h). See saveSnapshot and loadSnapshot
+ */
+typedef struct {
+  uint8_t raw[QN800X_SHADOW_SIZE];
+} qn800x_snapshot;
+
+/**
+ * @ingroup group00
+ * @brief Precomputed channel for frequency hopping (see buildHopTable and hopTo)
+ */
+typedef struct {
+  uint8_t ch;       //!< Lower 8 bits of the 10-bit channel index (QN_CH)
+  uint8_t chHigh;   //!< Highest 2 bits of the 10-bit channel index (CH field of QN_CH_STEP)
+} qn800x_hop;
+
+/**
+ * @ingroup group00
+ * @brief Device found by discoverDevices
+ */
+typedef struct {
+  uint8_t      address;   //!< 7-bit I2C address
+  uint8_t      error;     //!< Result of the ID reading: QN800X_I2C_OK or one of the QN800X_I2C_ERR_* codes
+  qn800x_cidr1 cidr1;     //!< CIDR1 (product ID). Valid when error is QN800X_I2C_OK
+  qn800x_cidr2 cidr2;     //!< CIDR2 (product ID). Valid when error is QN800X_I2C_OK
+  uint8_t      part;      //!< QN800X_PART_* decoded from CID3 (QN800X_PART_UNKNOWN on error)
+} qn800x_i2c_device;
+
+/**
+ * @ingroup group00
+ * @brief Station preset (see QN800XPresetStore)
+ */
+typedef struct {
+  uint16_t channel;   //!< 10-bit channel index
+  uint16_t pi;        //!< Program Identification (RDS_BLOCK1)
+  char     ps[8];     //!< Program Service name (not null terminated)
+  uint8_t  quality;   //!< Quality score defined by the application. Example: RSSI (dBuV)
+} qn800x_preset;
+
+/**
+ * @ingroup group00
+ * @brief Size in bytes of a preset blob with "count" presets (see QN800XPresetStore::save)
+ */
+#define QN800X_PRESET_BLOB_SIZE(count) (6 + 13 * (count))
+
+/**
+ * @ingroup group00
+ * @brief Station found by scanStations
+ */
+typedef struct {
+  uint16_t channel;   //!< 10-bit channel index
+  uint16_t pi;        //!< Program Identification (0 if no RDS was received in time)
+  uint8_t  rssi;      //!< In-band signal RSSI (dBuV)
+  uint8_t  snr;       //!< Estimated RF input CNR (dB)
+} qn800x_station;
+
+
+#if QN800X_FEATURE_RDS_RX
+class QN800XAfList;
+#endif
 
 /**
  * @ingroup  CLASSDEF
@@ -721,9 +1045,80 @@ class QN800X {
 private:
 
 
+#if QN800X_FEATURE_FREQ_STRING
 char strCurrentFrequency[8];  // Stores formated current frequency
+#endif
 uint16_t currentFrequency; 
 uint8_t  currentStep = 1;     //!<  current frequency step. Default is 100kHz
+uint16_t currentChannel = 0;  //!<  current 10-bit channel index
+
+#if QN800X_FEATURE_RDS_TX
+uint8_t  rdsTxUpdate = 0;     //!<  RDS_RXTXUPD (STATUS3) when the latest RDS group was sent
+#endif
+
+#if QN800X_FEATURE_RDS_RX
+uint8_t  rdsRxUpdate = 0;     //!<  RDS_RXTXUPD (STATUS3) when the latest RDS group was received
+#endif
+
+#if QN800X_FEATURE_POWER
+uint8_t  powerMode = 0;       //!<  RXREQ/TXREQ bits (SYSTEM1) restored when leaving standby
+bool     powerStandby = false;//!<  true while the device is in standby
+uint32_t powerPeriod = 0;     //!<  measurement window period in ms (0 = no schedule)
+uint16_t powerWindow = 0;     //!<  measurement window length in ms
+uint32_t powerCycleStart = 0; //!<  millis() at the beginning of the current window
+uint8_t  powerError = QN800X_I2C_OK; //!<  result of the latest wake up or standby started by powerTask
+#endif
+
+#if QN800X_FEATURE_ROLE_SWITCH
+qn800x_snapshot roleProfile[2];     //!<  register profiles of QN800X_ROLE_RX and QN800X_ROLE_TX
+#endif
+
+#if QN800X_FEATURE_TELEMETRY
+uint32_t tuneLatency = 0;     //!<  time (us) spent by the latest channel change
+#if QN800X_FEATURE_ROLE_SWITCH
+uint32_t roleSwitchTime = 0;  //!<  time (us) spent by the latest role switch
+#endif
+#if QN800X_FEATURE_POWER
+uint32_t powerMark = 0;       //!<  millis() at the latest standby transition
+uint32_t awakeTime = 0;       //!<  accumulated time (ms) out of standby
+uint32_t standbyTime = 0;     //!<  accumulated time (ms) in standby
+uint32_t wakeLatency = 0;     //!<  time (us) spent by the latest wake up
+#endif
+#endif
+
+uint8_t  i2cMaxRetries = QN800X_I2C_RETRIES;  //!< Extra attempts after a failed I2C transaction
+uint16_t i2cBackoff = QN800X_I2C_BACKOFF;     //!< Delay (us) before the first retry
+uint32_t i2cTimeout = QN800X_I2C_TIMEOUT;     //!< Wire timeout (us) per transaction
+uint8_t  lastI2CError = QN800X_I2C_OK;        //!< Result of the latest register access
+#if defined(PIN_WIRE_SDA) && defined(PIN_WIRE_SCL)
+int8_t   i2cSdaPin = PIN_WIRE_SDA;            //!< SDA pin used by the bus recovery
+int8_t   i2cSclPin = PIN_WIRE_SCL;            //!< SCL pin used by the bus recovery
+#else
+int8_t   i2cSdaPin = -1;                      //!< SDA pin used by the bus recovery (unknown)
+int8_t   i2cSclPin = -1;                      //!< SCL pin used by the bus recovery (unknown)
+#endif
+
+uint8_t  deviceAddress = QN800X_I2C_ADDRESS;  //!< 7-bit I2C address of the device
+int8_t   deviceDetected = -1;                  //!< Latest detection result: -1 = unknown; 0 = not found; 1 = found
+
+uint8_t  shadow[QN800X_SHADOW_SIZE];           //!< Latest known content of the registers 00h to 19h
+uint32_t shadowValid = 0;                      //!< Bit n set means shadow[n] is valid
+
+#if QN800X_FEATURE_TRACE
+Print   *traceOut = NULL;                      //!< Where the transaction trace is sent (NULL = disabled)
+uint32_t traceLast = 0;                        //!< micros() at the beginning of the previous traced transaction
+void traceTransaction(uint8_t registerNumber, const uint8_t *data, uint8_t count, bool isRead, uint8_t error, uint32_t start, bool probe = false);
+#endif
+
+uint8_t probeAddress(uint8_t address);
+uint8_t transfer(uint8_t registerNumber, uint8_t *data, uint8_t count, bool isRead);
+bool isCacheable(uint8_t registerNumber);
+bool needsSettling(uint8_t firstRegister, const uint8_t *data, uint8_t count);
+uint8_t getCommandBits(uint8_t registerNumber);
+uint8_t tune(uint8_t ch, uint8_t chHigh, bool waitSettling);
+void applyWireTimeout(uint32_t timeout);
+
+friend class QN800XBatch;
 
 protected:
 
@@ -735,19 +1130,176 @@ void begin() {
 
 }
 
-bool detectDevice();
+bool detectDevice(bool refresh = false);
 uint8_t scanI2CBus(uint8_t *device);
+uint8_t discoverDevices(qn800x_i2c_device *devices, uint8_t maxDevices, const uint8_t *allowlist = NULL, uint8_t allowCount = 0,
+                        uint32_t probeTimeout = QN800X_I2C_PROBE_TIMEOUT, uint16_t probeDelay = QN800X_I2C_PROBE_DELAY);
+void setDeviceAddress(uint8_t address);
+
+/**
+ * @ingroup group01 Device Checking
+ * @brief Returns the 7-bit I2C address used to access the device
+ */
+inline uint8_t getDeviceAddress() { return this->deviceAddress; };
 uint8_t getRegister(uint8_t registerNumber); 
 void setRegister(uint8_t registerNumber, uint8_t value);
 
+uint8_t readRegister(uint8_t registerNumber, uint8_t *value);
+uint8_t writeRegister(uint8_t registerNumber, uint8_t value);
+bool recoverI2CBus();
+void setI2CRetryPolicy(uint8_t maxRetries = QN800X_I2C_RETRIES, uint16_t backoff = QN800X_I2C_BACKOFF, uint32_t timeout = QN800X_I2C_TIMEOUT);
+uint32_t getI2CWorstCaseLatency();
+
+uint8_t readRegisters(uint8_t firstRegister, uint8_t *values, uint8_t count);
+uint8_t writeRegisters(uint8_t firstRegister, const uint8_t *values, uint8_t count);
+uint8_t getCachedRegister(uint8_t registerNumber, uint8_t *value);
+
+/**
+ * @ingroup group03 Register cache
+ * @brief Forgets all register values kept in RAM
+ * @details Call it if the device was reset or changed by other means (power cycle, another I2C master).
+ */
+inline void invalidateRegisterCache() { this->shadowValid = 0; };
+
+bool getRegisterInfo(uint8_t registerNumber, qn800x_reg_info *info);
+uint8_t saveSnapshot(qn800x_snapshot *snapshot);
+uint8_t loadSnapshot(const qn800x_snapshot *snapshot);
+uint8_t dumpRegisters(Print &out);
+
+#if QN800X_FEATURE_TRACE
+void setTrace(Print *out);
+#endif
+
+/**
+ * @ingroup group02 I2C
+ * @brief Sets the pins used by the SCL pulse bus recovery (see recoverI2CBus)
+ * @details Only needed when the platform does not define PIN_WIRE_SDA and PIN_WIRE_SCL or when you use other pins.
+ * @param sda SDA pin. Use -1 to disable the bus recovery.
+ * @param scl SCL pin. Use -1 to disable the bus recovery.
+ */
+inline void setI2CRecoveryPins(int8_t sda, int8_t scl) { this->i2cSdaPin = sda; this->i2cSclPin = scl; };
+
+/**
+ * @ingroup group02 I2C
+ * @brief Returns the result of the latest register access
+ * @return uint8_t QN800X_I2C_OK or one of the QN800X_I2C_ERR_* codes
+ */
+inline uint8_t getLastI2CError() { return this->lastI2CError; };
+
 qn800x_cidr1 getDeviceProductID();
 qn800x_cidr2 getDeviceProductFamily();
+static uint8_t decodePart(qn800x_cidr2 cidr2);
+
+/**
+ * @ingroup group02 I2C
+ * @brief Returns the part of the current device (QN8006, QN8006L, QN8007 or QN8007L)
+ * @return uint8_t one of the QN800X_PART_* values
+ */
+inline uint8_t getDevicePart() { return decodePart(this->getDeviceProductFamily()); };
+
 
 
 
+uint8_t setChannel(uint16_t channel, bool waitSettling = false);
+uint8_t setFrequency(uint16_t frequency, bool waitSettling = false);
+void buildHopTable(const uint16_t *frequencies, qn800x_hop *table, uint8_t count);
+uint8_t hopTo(const qn800x_hop &hop, bool waitSettling = false);
+
+/**
+ * @ingroup group04 Tune
+ * @brief Returns the current 10-bit channel index
+ */
+inline uint16_t getChannel() { return this->currentChannel; };
+
+/**
+ * @ingroup group04 Tune
+ * @brief Returns the current frequency (in 100kHz units. Example: 1069 means 106.9MHz)
+ */
+inline uint16_t getFrequency() { return this->currentFrequency; };
+
+#if QN800X_FEATURE_TELEMETRY
+/**
+ * @ingroup group04 Tune
+ * @brief Returns the time spent by the latest channel change
+ * @details It includes the settling time when the change was requested with waitSettling = true.
+ * @return uint32_t time in us
+ */
+inline uint32_t getTuneLatency() { return this->tuneLatency; };
+#endif
+
+#if QN800X_FEATURE_RX
+uint8_t waitForRxReady(uint16_t timeout = QN800X_SETTLING_TIMEOUT);
+uint8_t getSignalQuality(uint8_t *rssi, uint8_t *snr);
+#endif
+
+#if QN800X_FEATURE_SCAN
+uint8_t sweep(uint16_t firstChannel, uint16_t lastChannel, uint8_t step, Print &out, uint16_t settling = QN800X_SWEEP_SETTLING);
+#endif
+
+#if QN800X_FEATURE_RDS_TX
+uint8_t rdsSendGroup(const qn800x_rds_group &group);
+uint8_t rdsSendGroupFromFlash(const qn800x_rds_group *group);
+bool isRdsGroupFetched();
+#endif
+
+#if QN800X_FEATURE_RDS_RX
+uint8_t rdsGetGroup(qn800x_rds_group *group, qn800x_status3 *status = NULL);
+uint8_t switchToBestAF(const QN800XAfList &list, uint8_t margin, uint16_t timeout, uint16_t probe = QN800X_AF_PROBE, bool *switched = NULL);
+uint8_t rdsWaitPI(uint16_t *pi, uint16_t timeout);
+#endif
+
+#if QN800X_FEATURE_SCAN && QN800X_FEATURE_RDS_RX
+uint8_t scanStations(uint16_t firstChannel, uint16_t lastChannel, uint8_t step, uint8_t minRssi, qn800x_station *stations, uint8_t maxStations, uint8_t *found, uint16_t piTimeout = QN800X_PI_TIMEOUT, uint16_t settling = QN800X_SWEEP_SETTLING);
+#endif
+
+uint8_t restoreRegisters();
+
+#if QN800X_FEATURE_ROLE_SWITCH
+uint8_t saveRoleProfile(uint8_t role);
+void setRoleProfile(uint8_t role, const qn800x_snapshot *profile);
+uint8_t switchRole(uint8_t role, uint16_t timeout = QN800X_SETTLING_TIMEOUT);
+#if QN800X_FEATURE_TELEMETRY
+/**
+ * @ingroup group07 Role switch
+ * @brief Returns the time spent by the latest switchRole
+ * @details RX: until RXAGCSET was set. TX: until the mode request was written (there is no TX ready status).
+ * @return uint32_t time in us
+ */
+inline uint32_t getRoleSwitchTime() { return this->roleSwitchTime; };
+#endif
+#endif
+
+#if QN800X_FEATURE_POWER
+uint8_t setIdleTimeout(uint8_t timeout);
+uint8_t setStandby();
+uint8_t wakeUp(bool waitReady = true);
+void setPowerSchedule(uint32_t period, uint16_t window);
+uint8_t powerTask();
+
+/**
+ * @ingroup group06 Power
+ * @brief Returns the result of the latest wake up or standby started by powerTask
+ * @return uint8_t QN800X_I2C_OK, QN800X_ERR_NOT_READY (the RX AGC did not settle) or one of the QN800X_I2C_ERR_* codes
+ */
+inline uint8_t getPowerError() { return this->powerError; };
+#if QN800X_FEATURE_TELEMETRY
+uint16_t getDutyCycle();
+uint16_t getEstimatedDutyCycle();
+
+/**
+ * @ingroup group06 Power
+ * @brief Returns the time spent by the latest wake up
+ * @details RX: until RXAGCSET was set (waitReady). TX: until the mode request was written (there is no TX ready status).
+ * @return uint32_t time in us
+ */
+inline uint32_t getWakeLatency() { return this->wakeLatency; };
+#endif
+#endif
 
 void convertToChar(uint16_t value, char *strValue, uint8_t len, uint8_t dot, uint8_t separator = '.', bool remove_leading_zeros = true);
+#if QN800X_FEATURE_FREQ_STRING
 char* formatCurrentFrequency(char decimalSeparator = ',');
+#endif
 
 
 
@@ -797,4 +1349,336 @@ char* formatCurrentFrequency(char decimalSeparator = ',');
 
 
 };
+
+/**
+ * @ingroup  CLASSDEF
+ * @brief Register transaction batch
+ * @details Collects register and field updates and sends them to the device with the minimum number of I2C transactions.
+ * @details Multiple updates of the same register are merged and registers whose final value matches the
+ * @details content kept in RAM are not written. On commit, the remaining registers are sent in address order
+ * @details as contiguous burst writes. Close bursts are joined by rewriting up to QN800X_BATCH_MAX_GAP unchanged
+ * @details registers. SYSTEM1 (mode requests RXREQ, TXREQ, STNBY and CHSC) is always written last.
+ * @code
+ * #include <QN800X.h>
+ * QN800X dv;
+ * void setup() {
+ *   QN800XBatch batch(dv);
+ *   qn800x_txagc_gain agc;
+ *   agc.raw = batch.get(QN_TXAGC_GAIN);
+ *   agc.arg.TXAGC_GVGA = 5;
+ *   batch.setRegister(QN_TXAGC_GAIN, agc.raw);
+ *   batch.setRegister(QN_TX_FDEV, 108);
+ *   batch.setField(QN_SYSTEM1, 0b01000000, 0b01000000); // TXREQ = 1
+ *   batch.commit();
+ * }
+ * @endcode
+ */
+class QN800XBatch {
+private:
+  QN800X  *device;
+  uint8_t  value[QN800X_SHADOW_SIZE];   //!< Pending register values
+  uint32_t touched = 0;                 //!< Bit n set means value[n] is pending
+  uint8_t  transactions = 0;            //!< I2C transactions used by the latest commit
+
+public:
+  QN800XBatch(QN800X &device) : device(&device) {};
+
+  uint8_t get(uint8_t registerNumber);
+  uint8_t setRegister(uint8_t registerNumber, uint8_t value);
+  uint8_t setField(uint8_t registerNumber, uint8_t mask, uint8_t value);
+  uint8_t commit();
+
+  /**
+   * @ingroup group03 Register cache
+   * @brief Discards all pending updates
+   */
+  inline void clear() { this->touched = 0; };
+
+  /**
+   * @ingroup group03 Register cache
+   * @brief Returns the number of I2C write transactions used by the latest commit
+   */
+  inline uint8_t getTransactionCount() { return this->transactions; };
+};
+
+#if QN800X_FEATURE_RDS_TX
+/**
+ * @ingroup  CLASSDEF
+ * @brief RDS RadioText (2A) and Clock Time (4A) group encoder
+ * @details Keeps the text and time being transmitted and regenerates only the groups affected by an update.
+ * @details Each updated RadioText segment and the Clock Time are marked as pending; nextGroup returns them first,
+ * @details one at a time. When nothing is pending, nextGroup cycles through the Program Service name groups and the
+ * @details RadioText segments, so the transmission never stops.
+ * @details The static Program Service name groups (0A) should be built at compile time with QN800X_RDS_PS_GROUPS.
+ * @code
+ * static constexpr qn800x_rds_group stationPS[4] PROGMEM = QN800X_RDS_PS_GROUPS(0x1234, 10, false, false, true, 0, "PU2CLR  ");
+ * QN800XRdsEncoder rds(0x1234, 10);
+ * qn800x_rds_group group;
+ * rds.setPS(stationPS);
+ * rds.setRT("Now playing: ...");
+ * for (;;) {
+ *   if (tx.isRdsGroupFetched() && rds.nextGroup(group))
+ *     tx.rdsSendGroup(group);
+ * }
+ * @endcode
+ */
+class QN800XRdsEncoder {
+private:
+  uint16_t pi;              //!< Program Identification
+  uint8_t  pty;             //!< Program Type code
+  bool     tp;              //!< Traffic Program code
+  bool     rtAB = false;    //!< RadioText A/B flag
+  char     rt[64];          //!< RadioText being transmitted (padded)
+  uint16_t ct[3];           //!< Blocks 2 (5 least significant bits), 3 and 4 of the Clock Time group
+  uint32_t pending = 0;     //!< Bits 0 to 15: RadioText segments; bit 16: Clock Time
+  uint8_t  rtSegments = 0;  //!< Segments of the current RadioText (0 = no RadioText)
+  uint8_t  cycle = 0;       //!< Next group of the cycle: 0 to 3 PS groups, then the RadioText segments
+  const qn800x_rds_group *ps = NULL;  //!< The four 0A groups in flash (see setPS)
+
+public:
+  QN800XRdsEncoder(uint16_t pi, uint8_t pty, bool tp = false);
+
+  /**
+   * @ingroup group05 RDS TX
+   * @brief Sets the Program Service name groups cycled by nextGroup
+   * @param groups the four 0A groups in flash (QN800X_RDS_PS_GROUPS array) or NULL
+   */
+  inline void setPS(const qn800x_rds_group *groups) { this->ps = groups; };
+
+  void setRT(const char *text, bool clear = false);
+  void setCT(uint32_t mjd, uint8_t hour, uint8_t minute, int8_t offset = 0);
+  void getRTGroup(uint8_t segment, qn800x_rds_group &group);
+  bool nextGroup(qn800x_rds_group &group);
+
+  /**
+   * @ingroup group05 RDS TX
+   * @brief Checks if there are groups waiting to be transmitted
+   */
+  inline bool hasPendingGroups() { return this->pending != 0; };
+};
+#endif
+
+#if QN800X_FEATURE_RDS_RX
+/**
+ * @ingroup  CLASSDEF
+ * @brief Alternative Frequency (AF) list decoder
+ * @details Collects the AF codes carried by block 3 of the received 0A groups of a station.
+ * @details Both AF methods are accepted: method B pairs (tuned frequency, alternative) add the tuned frequency too,
+ * @details which is ignored by QN800X::switchToBestAF. LF/MF frequencies are skipped.
+ * @details The list is cleared when a group with a different PI arrives.
+ * @code
+ * QN800XAfList afs;
+ * qn800x_rds_group group;
+ * if (rx.rdsGetGroup(&group) == QN800X_I2C_OK)
+ *   afs.decode(group);
+ * @endcode
+ */
+class QN800XAfList {
+private:
+  uint16_t pi = 0;                        //!< Station the list belongs to
+  uint8_t  count = 0;                     //!< Number of alternative frequencies
+  bool     skipNext = false;              //!< The next code is a LF/MF frequency
+  uint16_t channel[QN800X_AF_MAX];        //!< Alternative frequencies (10-bit channel indexes)
+
+public:
+  bool decode(const qn800x_rds_group &group);
+
+  /**
+   * @ingroup group10 RDS RX
+   * @brief Removes all alternative frequencies
+   */
+  inline void clear() { this->count = 0; this->skipNext = false; };
+
+  /**
+   * @ingroup group10 RDS RX
+   * @brief Returns the PI of the station that sent the list
+   */
+  inline uint16_t getPI() const { return this->pi; };
+
+  /**
+   * @ingroup group10 RDS RX
+   * @brief Returns the number of alternative frequencies
+   */
+  inline uint8_t getCount() const { return this->count; };
+
+  /**
+   * @ingroup group10 RDS RX
+   * @brief Returns an alternative frequency as a 10-bit channel index (see QN800X::setChannel)
+   */
+  inline uint16_t getChannel(uint8_t index) const { return this->channel[index]; };
+};
+
+/**
+ * @ingroup  CLASSDEF
+ * @brief Station preset store
+ * @details Keeps up to QN800X_PRESET_MAX presets sorted by channel, plus an index sorted by PI, so both lookups
+ * @details are binary searches. The presets can be saved to a small blob (EEPROM, flash, file) and loaded back.
+ * @code
+ * QN800XPresetStore presets;
+ * qn800x_preset p = {(1069 - 760) * 2, 0xC203, {'P','U','2','C','L','R',' ',' '}, 45};
+ * presets.add(p);
+ * uint8_t blob[QN800X_PRESET_BLOB_SIZE(QN800X_PRESET_MAX)];
+ * uint16_t size = presets.save(blob, sizeof(blob));
+ * for (uint16_t i = 0; i < size; i++)
+ *   EEPROM.update(i, blob[i]);
+ * ...
+ * int8_t index = presets.findByPI(0xC203);
+ * if (index >= 0)
+ *   rx.setChannel(presets.get(index).channel, true);
+ * @endcode
+ */
+class QN800XPresetStore {
+private:
+  qn800x_preset preset[QN800X_PRESET_MAX];  //!< Presets sorted by channel
+  uint8_t  byPI[QN800X_PRESET_MAX];         //!< Indexes of preset sorted by PI
+  uint8_t  count = 0;                       //!< Number of presets
+
+  void indexPI();
+
+public:
+  bool add(const qn800x_preset &entry);
+  bool remove(uint16_t channel);
+  int8_t findByChannel(uint16_t channel) const;
+  int8_t findByPI(uint16_t pi) const;
+  uint16_t save(uint8_t *blob, uint16_t size) const;
+  bool load(const uint8_t *blob, uint16_t size);
+
+  /**
+   * @ingroup group11 Presets
+   * @brief Returns a preset (index from 0 to getCount() - 1, in channel order)
+   */
+  inline const qn800x_preset &get(uint8_t index) const { return this->preset[index]; };
+
+  /**
+   * @ingroup group11 Presets
+   * @brief Returns the number of presets
+   */
+  inline uint8_t getCount() const { return this->count; };
+
+  /**
+   * @ingroup group11 Presets
+   * @brief Removes all presets
+   */
+  inline void clear() { this->count = 0; };
+};
+#endif
+
+#if QN800X_FEATURE_CMD_QUEUE
+/**
+ * @ingroup group09 Command queue
+ * @brief Command completion callback
+ * @details Called by the owner task. Keep it short.
+ * @param error QN800X_I2C_OK or one of the QN800X error codes
+ * @param value register value (QN800X_CMD_READ, QN800X_CMD_UPDATE) or 0
+ * @param context pointer given to submit
+ */
+typedef void (*qn800x_cmd_callback)(uint8_t error, uint8_t value, void *context);
+
+/**
+ * @ingroup group09 Command queue
+ * @brief Result of a command submitted to QN800XCommandQueue
+ * @details The task that submits the command waits on it with wait(). Completion uses the FreeRTOS task notification
+ * @details of the waiting task.
+ * @details The owner task writes error and value before it sets done with release ordering; isDone and wait read done
+ * @details with acquire ordering, so error and value are valid once the command is seen as executed.
+ */
+class QN800XFuture {
+private:
+  bool done = true;             //!< true when the command was executed. Access it only through isDone and setDone.
+  TaskHandle_t waiter = NULL;   //!< Task that submitted the command
+
+  inline void setDone(bool value) { __atomic_store_n(&this->done, value, __ATOMIC_RELEASE); };
+
+  friend class QN800XCommandQueue;
+
+public:
+  uint8_t error = QN800X_I2C_OK;//!< Command result
+  uint8_t value = 0;            //!< Register value (QN800X_CMD_READ and QN800X_CMD_UPDATE)
+
+  /**
+   * @brief Checks if the command was executed
+   * @return true if error and value hold the result
+   */
+  inline bool isDone() const { return __atomic_load_n(&this->done, __ATOMIC_ACQUIRE); };
+
+  bool wait(TickType_t timeout = portMAX_DELAY);
+};
+
+/**
+ * @ingroup group00
+ * @brief Pending command of QN800XCommandQueue
+ */
+typedef struct {
+  uint8_t  type;                  //!< QN800X_CMD_READ, QN800X_CMD_WRITE, QN800X_CMD_UPDATE or QN800X_CMD_TUNE
+  uint8_t  priority;              //!< Higher values run first
+  uint8_t  reg;                   //!< Register address
+  uint8_t  mask;                  //!< Bits changed by QN800X_CMD_UPDATE
+  uint16_t value;                 //!< Register value or channel
+  uint16_t sequence;              //!< Submission order
+  QN800XFuture *future;           //!< Result (optional)
+  qn800x_cmd_callback callback;   //!< Completion callback (optional)
+  void *context;                  //!< Callback context
+} qn800x_cmd;
+
+/**
+ * @ingroup  CLASSDEF
+ * @brief Thread-safe command queue for multi-task (FreeRTOS) access to the device
+ * @details Several tasks submit typed commands with a priority; a single owner task runs them with process().
+ * @details Only the owner task touches the I2C bus, so each command (including read-modify-write) is atomic.
+ * @details A write or update of a register that is still pending with a write or update is merged into it,
+ * @details as long as at most one of them waits for a result. Pending tunes are merged the same way.
+ * @details Enable it with QN800X_FEATURE_CMD_QUEUE (see QN800XConfig.h).
+ * @code
+ * QN800X dv;
+ * QN800XCommandQueue commands(dv);
+ *
+ * void ownerTask(void *) {
+ *   for (;;) commands.process();
+ * }
+ *
+ * void uiTask(void *) {
+ *   QN800XFuture result;
+ *   for (;;) {
+ *     commands.submit(QN800X_CMD_READ, QN_STATUS1, 0, 0, 1, &result);
+ *     if (result.wait(pdMS_TO_TICKS(100)) && result.error == QN800X_I2C_OK) {
+ *       ...
+ *     }
+ *   }
+ * }
+ *
+ * void setup() {
+ *   commands.begin();
+ *   xTaskCreate(ownerTask, "qn800x", 4096, NULL, 2, NULL);
+ *   xTaskCreate(uiTask, "ui", 4096, NULL, 1, NULL);
+ * }
+ * @endcode
+ */
+class QN800XCommandQueue {
+private:
+  QN800X *device;
+  qn800x_cmd queue[QN800X_CMD_QUEUE_SIZE];
+  uint8_t count = 0;
+  uint16_t sequence = 0;
+  uint16_t merged = 0;              //!< Commands merged into pending ones
+  SemaphoreHandle_t lock = NULL;    //!< Protects the queue
+  SemaphoreHandle_t signal = NULL;  //!< Wakes the owner task
+
+  uint8_t execute(qn800x_cmd &command, uint8_t *value);
+
+public:
+  QN800XCommandQueue(QN800X &device) : device(&device) {};
+
+  bool begin();
+  bool submit(uint8_t type, uint8_t reg, uint8_t mask, uint16_t value, uint8_t priority = 0,
+              QN800XFuture *future = NULL, qn800x_cmd_callback callback = NULL, void *context = NULL);
+  uint8_t process(TickType_t wait = portMAX_DELAY);
+
+  /**
+   * @ingroup group09 Command queue
+   * @brief Returns how many commands were merged into pending ones
+   */
+  inline uint16_t getMergedCount() { return this->merged; };
+};
+#endif
+
 #endif // _QN800X_H
\ No newline at end of file
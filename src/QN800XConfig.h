@@ -0,0 +1,72 @@
+/**
+ * @brief QN800X (QN8006 and QN8007) ARDUINO LIBRARY - Build configuration
+ *
+ * @details Selects the library components compiled into your sketch. A disabled component adds no flash and no RAM.
+ * @details Set a component to 0 to remove it. The core (register access, register cache, batch and tune) is always present.
+ * @details The transmitter needs no component of its own: besides RDS (QN800X_FEATURE_RDS_TX), it only uses the core.
+ * @details The Arduino IDE compiles the library apart from the sketch, so a #define in the sketch does not reach the library.
+ * @details Change the values in this file or pass them as build flags. Examples:
+ * @details - arduino-cli: --build-property "compiler.cpp.extra_flags=-DQN800X_FEATURE_RDS_TX=0"
+ * @details - PlatformIO (platformio.ini): build_flags = -DQN800X_FEATURE_RDS_TX=0
+ * @details The script extras/tools/size_report.sh prints the flash/RAM cost of each component.
+ *
+ * @author PU2CLR - Ricardo Lima Caratti
+ * @date  2024
+ */
+
+#ifndef _QN800X_CONFIG_H // Prevent this file from being compiled more than once
+#define _QN800X_CONFIG_H
+
+#ifndef QN800X_FEATURE_RX
+#define QN800X_FEATURE_RX 1           //!< Receiver functions (RX readiness, signal quality)
+#endif
+
+#ifndef QN800X_FEATURE_RDS_TX
+#define QN800X_FEATURE_RDS_TX 1       //!< RDS group encoder and transmission
+#endif
+
+#ifndef QN800X_FEATURE_RDS_RX
+#define QN800X_FEATURE_RDS_RX 1       //!< RDS reception (requires QN800X_FEATURE_RX)
+#endif
+
+#ifndef QN800X_FEATURE_SCAN
+#define QN800X_FEATURE_SCAN 1         //!< Channel scanning and sweep (requires QN800X_FEATURE_RX)
+#endif
+
+#ifndef QN800X_FEATURE_POWER
+#define QN800X_FEATURE_POWER 1        //!< Standby management and power schedule
+#endif
+
+#ifndef QN800X_FEATURE_ROLE_SWITCH
+#define QN800X_FEATURE_ROLE_SWITCH 1  //!< RX/TX role profiles and switchRole: 2 register snapshots in RAM (requires RX)
+#endif
+
+#ifndef QN800X_FEATURE_TELEMETRY
+#define QN800X_FEATURE_TELEMETRY 1    //!< Latency and duty cycle measurements
+#endif
+
+#ifndef QN800X_FEATURE_CMD_QUEUE
+#define QN800X_FEATURE_CMD_QUEUE 0    //!< Thread-safe command queue for multi-task access (requires FreeRTOS)
+#endif
+
+#ifndef QN800X_FEATURE_TRACE
+#define QN800X_FEATURE_TRACE 0        //!< Binary trace of all register transactions (see setTrace)
+#endif
+
+#ifndef QN800X_FEATURE_FREQ_STRING
+#define QN800X_FEATURE_FREQ_STRING 1  //!< formatCurrentFrequency and its 8-byte buffer
+#endif
+
+#if QN800X_FEATURE_RDS_RX && !QN800X_FEATURE_RX
+#error "QN800X_FEATURE_RDS_RX requires QN800X_FEATURE_RX"
+#endif
+
+#if QN800X_FEATURE_SCAN && !QN800X_FEATURE_RX
+#error "QN800X_FEATURE_SCAN requires QN800X_FEATURE_RX"
+#endif
+
+#if QN800X_FEATURE_ROLE_SWITCH && !QN800X_FEATURE_RX
+#error "QN800X_FEATURE_ROLE_SWITCH requires QN800X_FEATURE_RX"
+#endif
+
+#endif // _QN800X_CONFIG_H